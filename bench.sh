@@ -0,0 +1,91 @@
+#!/bin/bash
+# Replays the workloads of the given generator through the given executable
+# and reports the throughput of the mixed stream of every shape in
+# operations per second, and the mean latency of every command type
+# in microseconds. The setup of a shape is timed separately and subtracted.
+# Every stream is replayed $REPEAT times and the best time is taken.
+#
+# Arg1 -- Name of the executable to be measured
+# Arg2 -- Name of the workload generator
+# Environment:
+# COUNT -- number of measured operations per stream, 20000 by default
+# REPEAT -- number of replays of every stream, 5 by default
+# BENCHARGS -- options passed to the executable, e.g. -t 4
+#
+# Author: Mateusz Gienieczko
+# Copyright (C) 2018
+
+if [ $# != 2 ];
+then
+	echo "You need to pass exactly two arguments: program name \
+and workload generator name.";
+	exit 1;
+fi
+
+PROG=$1
+WORKLOAD=$2
+
+COUNT=${COUNT:-20000}
+REPEAT=${REPEAT:-5}
+
+SHAPES="chain fanout movies churn largek"
+PHASES="mixed addUser delUser addMovie delMovie marathon"
+
+STREAM="$(mktemp)";
+
+# Prints the best time of replaying $STREAM in nanoseconds.
+best_time() {
+
+	BEST=""
+
+	for ((i = 0; i < REPEAT; ++i)); do
+
+		START=$(date +%s%N)
+		./$PROG $BENCHARGS < $STREAM &>/dev/null
+		END=$(date +%s%N)
+
+		if [ -z "$BEST" ] || [ $((END - START)) -lt $BEST ];
+		then BEST=$((END - START));
+		fi
+
+	done
+
+	echo $BEST
+}
+
+printf "%-8s %12s %10s %10s %10s %10s %10s\n" shape "ops/sec" \
+	"addUser" "delUser" "addMovie" "delMovie" "marathon"
+
+for SHAPE in $SHAPES; do
+
+	./$WORKLOAD $SHAPE setup > $STREAM
+	SETUP=$(best_time)
+
+	printf "%-8s" $SHAPE
+
+	for PHASE in $PHASES; do
+
+		./$WORKLOAD $SHAPE $PHASE $COUNT > $STREAM
+		TIME=$(($(best_time) - SETUP))
+
+		# Setup noise may exceed the time of very cheap operations.
+		if [ $TIME -lt 1 ];
+		then
+			if [ $PHASE = mixed ];
+			then printf " %12s" "-";
+			else printf " %10s" "-";
+			fi
+		elif [ $PHASE = mixed ];
+		then printf " %12d" $((COUNT * 1000000000 / TIME));
+		else awk -v t=$TIME -v c=$COUNT 'BEGIN { printf " %10.3f", t / c / 1000 }';
+		fi
+
+	done
+
+	echo
+
+done
+
+echo "Latencies in microseconds per operation, - if below the noise."
+
+rm -f $STREAM
@@ -0,0 +1,104 @@
+/**
+ * Implementation of arena.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include "arena.h"
+#include "defines.h"
+
+// Number of objects carved out of a single chunk.
+#define ARENA_CHUNK_OBJECTS 256
+
+// Internal auxiliary function returning the object size rounded up, so that
+// every object is aligned like the chunk header and can hold a free link.
+static size_t arena_stride(size_t objectSize);
+
+
+arena_t *arena_make(size_t objectSize) {
+
+    arena_t *arena = malloc(sizeof(arena_t));
+
+    // Assure that malloc has not failed.
+    NNULL(arena, "arena_make");
+
+    arena->objectSize = arena_stride(objectSize);
+    arena->chunks = NULL;
+    arena->used = ARENA_CHUNK_OBJECTS;
+    arena->freeObjects = NULL;
+
+    return arena;
+}
+
+void *arena_alloc(arena_t *arena) {
+
+    NNULL(arena, "arena_alloc");
+
+    // Reuse a freed object if there is one.
+    if(arena->freeObjects != NULL) {
+
+        arena_free_t *object = arena->freeObjects;
+        arena->freeObjects = object->next;
+
+        return object;
+    }
+
+    // Carve a new chunk when the current one is used up.
+    if(arena->used == ARENA_CHUNK_OBJECTS) {
+
+        arena_chunk_t *chunk = malloc(arena_stride(sizeof(arena_chunk_t)) +
+                                      ARENA_CHUNK_OBJECTS * arena->objectSize);
+
+        // Assure that malloc has not failed.
+        NNULL(chunk, "arena_alloc");
+
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->used = 0;
+    }
+
+    char *objects = (char *) arena->chunks +
+                    arena_stride(sizeof(arena_chunk_t));
+
+    return objects + arena->used++ * arena->objectSize;
+}
+
+void arena_free(arena_t *arena, void *object) {
+
+    NNULL(arena, "arena_free");
+    NNULL(object, "object/arena_free");
+
+    arena_free_t *freed = object;
+
+    freed->next = arena->freeObjects;
+    arena->freeObjects = freed;
+}
+
+void arena_destroy(arena_t **arena) {
+
+    NNULL(*arena, "arena_destroy");
+
+    while((*arena)->chunks != NULL) {
+
+        arena_chunk_t *next = (*arena)->chunks->next;
+
+        free((*arena)->chunks);
+
+        (*arena)->chunks = next;
+    }
+
+    free(*arena);
+
+    *arena = NULL;
+}
+
+static size_t arena_stride(size_t objectSize) {
+
+    size_t alignment = _Alignof(max_align_t);
+
+    if(objectSize < sizeof(arena_free_t)) {
+        objectSize = sizeof(arena_free_t);
+    }
+
+    return (objectSize + alignment - 1) / alignment * alignment;
+}
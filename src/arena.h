@@ -0,0 +1,57 @@
+/**
+ * Region arena of fixed-size objects. Objects are carved out of large
+ * chunks, freed ones are kept on a free list and handed out again first,
+ * so allocation and freeing take constant time and hardly ever reach
+ * malloc. Destroying the arena releases every object at once with one free
+ * per chunk, without visiting the objects.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Block of memory the objects are carved out of. Chunks are linked
+// together so that they can all be released at the end.
+typedef struct arena_chunk_t {
+
+    struct arena_chunk_t *next;
+
+} arena_chunk_t;
+
+// Freed object waiting for reuse, linked through its first bytes.
+typedef struct arena_free_t {
+
+    struct arena_free_t *next;
+
+} arena_free_t;
+
+// The arena. Objects of the most recent chunk from position used on
+// have not been handed out yet.
+typedef struct arena_t {
+
+    size_t objectSize;
+    arena_chunk_t *chunks;
+    size_t used;
+    arena_free_t *freeObjects;
+
+} arena_t;
+
+// Makes a new arena object handing out objects of the given size.
+arena_t *arena_make(size_t objectSize);
+
+// Gives memory for a single object, not initialised.
+void *arena_alloc(arena_t *arena);
+
+// Gives the memory of the object back to the arena for reuse.
+void arena_free(arena_t *arena, void *object);
+
+// Releases the memory of all the objects at once, they are all invalid
+// afterwards, and NULLs the pointer. Takes time linear in the number
+// of chunks.
+void arena_destroy(arena_t **arena);
+
+#endif // ARENA_H
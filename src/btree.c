@@ -0,0 +1,610 @@
+/**
+ * Implementation of btree.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include <string.h>
+#include "btree.h"
+#include "arena.h"
+#include "defines.h"
+
+// Below this number of keys of a leaf or children of an inner node,
+// the node is merged with or refilled from a sibling. Does not apply
+// to the root.
+#define BTREE_MIN_SIZE (BTREE_ORDER / 2)
+
+// Outcomes of an insertion into a subtree.
+typedef enum btree_result_t {
+
+    BTREE_DUPLICATE,
+    BTREE_INSERTED,
+    BTREE_SPLIT
+
+} btree_result_t;
+
+// Arenas all the trees and their nodes are allocated from, one per type,
+// made with the first tree.
+static arena_t *trees = NULL;
+static arena_t *leaves = NULL;
+static arena_t *inners = NULL;
+
+// Internal auxiliary function returning the position of the first key
+// not greater than the given one, size if all of them are greater.
+static unsigned int btree_lower_bound(const int *keys, unsigned int size,
+                                      int key);
+
+// Internal auxiliary function returning the child of the inner node
+// whose subtree holds the key if it is present.
+static unsigned int btree_child(const btree_inner_t *inner, int key);
+
+// Internal auxiliary function inserting the key into the subtree of given
+// height. If the node is split, the new right node and the separator
+// between the two are passed back.
+static btree_result_t btree_insert_into(void *node, unsigned int height,
+                                        int key, int *separator,
+                                        void **right);
+
+// Internal auxiliary function removing the key from the subtree of given
+// height. Refills the child the key was removed from if it has become
+// too small.
+static bool btree_remove_from(void *node, unsigned int height, int key);
+
+// Internal auxiliary function merging the child of the parent with
+// a sibling, or moving some of the sibling's entries to it if they do not
+// fit together. The children have the given height.
+static void btree_rebalance(btree_inner_t *parent, unsigned int child,
+                            unsigned int height);
+
+// Internal auxiliary function removing the separator and the child after it
+// from the inner node.
+static void btree_remove_child(btree_inner_t *inner, unsigned int separator);
+
+// Internal auxiliary functions making new empty nodes.
+static btree_leaf_t *btree_make_leaf();
+static btree_inner_t *btree_make_inner();
+
+// Internal auxiliary function releasing the subtree of given height.
+static void btree_destroy_node(void *node, unsigned int height);
+
+
+btree_t *btree_make() {
+
+    if(trees == NULL) {
+
+        trees = arena_make(sizeof(btree_t));
+        leaves = arena_make(sizeof(btree_leaf_t));
+        inners = arena_make(sizeof(btree_inner_t));
+    }
+
+    btree_t *tree = arena_alloc(trees);
+
+    tree->first = btree_make_leaf();
+    tree->root = tree->first;
+    tree->height = 0;
+    tree->size = 0;
+
+    return tree;
+}
+
+btree_t *btree_make_sorted(const int *keys, size_t count) {
+
+    btree_t *tree = btree_make();
+
+    tree->size = count;
+
+    if(count <= BTREE_ORDER) {
+
+        memcpy(tree->first->keys, keys, count * sizeof(int));
+        tree->first->size = (unsigned int) count;
+
+        return tree;
+    }
+
+    // Nodes of the level being built, from the largest keys, and the
+    // largest key under each of them.
+    size_t nodeCount = (count + BTREE_ORDER - 1) / BTREE_ORDER;
+    void **nodes = malloc(nodeCount * sizeof(void *));
+    int *maxima = malloc(nodeCount * sizeof(int));
+
+    // Assure that malloc has not failed.
+    NNULL(nodes, "nodes/btree_make_sorted");
+    NNULL(maxima, "maxima/btree_make_sorted");
+
+    btree_leaf_t *previous = NULL;
+    size_t offset = 0;
+
+    for(size_t i = 0; i < nodeCount; ++i) {
+
+        // Spread the keys evenly, so every leaf is at least half full.
+        size_t size = count / nodeCount + (i < count % nodeCount ? 1 : 0);
+        btree_leaf_t *leaf = i == 0 ? tree->first : btree_make_leaf();
+
+        memcpy(leaf->keys, keys + offset, size * sizeof(int));
+        leaf->size = (unsigned int) size;
+
+        if(previous != NULL) {
+            previous->next = leaf;
+        }
+
+        previous = leaf;
+        nodes[i] = leaf;
+        maxima[i] = keys[offset];
+        offset += size;
+    }
+
+    // Build the levels above in place, a parent never comes after
+    // its first child.
+    while(nodeCount > 1) {
+
+        size_t parentCount = (nodeCount + BTREE_ORDER - 1) / BTREE_ORDER;
+        size_t child = 0;
+
+        for(size_t i = 0; i < parentCount; ++i) {
+
+            size_t size = nodeCount / parentCount +
+                          (i < nodeCount % parentCount ? 1 : 0);
+            btree_inner_t *inner = btree_make_inner();
+            int maximum = maxima[child];
+
+            for(size_t j = 0; j < size; ++j) {
+
+                inner->children[j] = nodes[child + j];
+
+                if(j > 0) {
+                    inner->keys[j - 1] = maxima[child + j];
+                }
+            }
+
+            inner->size = (unsigned int) size;
+
+            nodes[i] = inner;
+            maxima[i] = maximum;
+            child += size;
+        }
+
+        nodeCount = parentCount;
+        ++tree->height;
+    }
+
+    tree->root = nodes[0];
+
+    free(nodes);
+    free(maxima);
+
+    return tree;
+}
+
+bool btree_insert(btree_t *tree, int key) {
+
+    NNULL(tree, "btree_insert");
+
+    int separator;
+    void *right;
+
+    btree_result_t result = btree_insert_into(tree->root, tree->height, key,
+                                              &separator, &right);
+
+    if(result == BTREE_DUPLICATE) {
+        return false;
+    }
+
+    // The root has been split, the tree grows by a level.
+    if(result == BTREE_SPLIT) {
+
+        btree_inner_t *root = btree_make_inner();
+
+        root->size = 2;
+        root->keys[0] = separator;
+        root->children[0] = tree->root;
+        root->children[1] = right;
+
+        tree->root = root;
+        ++tree->height;
+    }
+
+    ++tree->size;
+
+    return true;
+}
+
+bool btree_remove(btree_t *tree, int key) {
+
+    NNULL(tree, "btree_remove");
+
+    if(!btree_remove_from(tree->root, tree->height, key)) {
+        return false;
+    }
+
+    // The root with a single child is dropped, the tree shrinks by a level.
+    if(tree->height > 0 && ((btree_inner_t *) tree->root)->size == 1) {
+
+        btree_inner_t *root = tree->root;
+
+        tree->root = root->children[0];
+        --tree->height;
+
+        arena_free(inners, root);
+    }
+
+    --tree->size;
+
+    return true;
+}
+
+bool btree_contains(const btree_t *tree, int key) {
+
+    NNULL(tree, "btree_contains");
+
+    const btree_leaf_t *leaf = btree_find_leaf(tree, key);
+    unsigned int position = btree_lower_bound(leaf->keys, leaf->size, key);
+
+    return position < leaf->size && leaf->keys[position] == key;
+}
+
+const btree_leaf_t *btree_find_leaf(const btree_t *tree, int key) {
+
+    NNULL(tree, "btree_find_leaf");
+
+    const void *node = tree->root;
+
+    for(unsigned int height = tree->height; height > 0; --height) {
+
+        const btree_inner_t *inner = node;
+
+        node = inner->children[btree_child(inner, key)];
+    }
+
+    return node;
+}
+
+void btree_destroy(btree_t **tree) {
+
+    NNULL(*tree, "btree_destroy");
+
+    btree_destroy_node((*tree)->root, (*tree)->height);
+
+    arena_free(trees, *tree);
+
+    *tree = NULL;
+}
+
+void btree_release_all() {
+
+    if(trees == NULL) {
+        return;
+    }
+
+    arena_destroy(&trees);
+    arena_destroy(&leaves);
+    arena_destroy(&inners);
+}
+
+static unsigned int btree_lower_bound(const int *keys, unsigned int size,
+                                      int key) {
+
+    unsigned int low = 0;
+    unsigned int high = size;
+
+    while(low < high) {
+
+        unsigned int mid = low + (high - low) / 2;
+
+        if(keys[mid] > key) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static unsigned int btree_child(const btree_inner_t *inner, int key) {
+
+    // Count the separators not smaller than the key.
+    unsigned int low = 0;
+    unsigned int high = inner->size - 1;
+
+    while(low < high) {
+
+        unsigned int mid = low + (high - low) / 2;
+
+        if(inner->keys[mid] >= key) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static btree_result_t btree_insert_into(void *node, unsigned int height,
+                                        int key, int *separator,
+                                        void **right) {
+
+    if(height == 0) {
+
+        btree_leaf_t *leaf = node;
+        unsigned int position = btree_lower_bound(leaf->keys, leaf->size, key);
+
+        if(position < leaf->size && leaf->keys[position] == key) {
+            return BTREE_DUPLICATE;
+        }
+
+        if(leaf->size < BTREE_ORDER) {
+
+            memmove(leaf->keys + position + 1, leaf->keys + position,
+                    (leaf->size - position) * sizeof(int));
+
+            leaf->keys[position] = key;
+            ++leaf->size;
+
+            return BTREE_INSERTED;
+        }
+
+        // Split the full leaf in halves and insert into the proper one.
+        btree_leaf_t *newLeaf = btree_make_leaf();
+
+        newLeaf->size = BTREE_ORDER - BTREE_ORDER / 2;
+        memcpy(newLeaf->keys, leaf->keys + BTREE_ORDER / 2,
+               newLeaf->size * sizeof(int));
+
+        leaf->size = BTREE_ORDER / 2;
+
+        newLeaf->next = leaf->next;
+        leaf->next = newLeaf;
+
+        btree_leaf_t *target = position <= leaf->size ? leaf : newLeaf;
+
+        if(target == newLeaf) {
+            position -= leaf->size;
+        }
+
+        memmove(target->keys + position + 1, target->keys + position,
+                (target->size - position) * sizeof(int));
+
+        target->keys[position] = key;
+        ++target->size;
+
+        *separator = newLeaf->keys[0];
+        *right = newLeaf;
+
+        return BTREE_SPLIT;
+    }
+
+    btree_inner_t *inner = node;
+    unsigned int child = btree_child(inner, key);
+
+    int childSeparator;
+    void *childRight;
+
+    btree_result_t result = btree_insert_into(inner->children[child],
+                                              height - 1, key,
+                                              &childSeparator, &childRight);
+
+    if(result != BTREE_SPLIT) {
+        return result;
+    }
+
+    if(inner->size < BTREE_ORDER) {
+
+        memmove(inner->keys + child + 1, inner->keys + child,
+                (inner->size - 1 - child) * sizeof(int));
+        memmove(inner->children + child + 2, inner->children + child + 1,
+                (inner->size - 1 - child) * sizeof(void *));
+
+        inner->keys[child] = childSeparator;
+        inner->children[child + 1] = childRight;
+        ++inner->size;
+
+        return BTREE_INSERTED;
+    }
+
+    // Gather all the entries of the full node and split them in halves,
+    // the separator between the halves goes up.
+    int keys[BTREE_ORDER];
+    void *children[BTREE_ORDER + 1];
+
+    memcpy(keys, inner->keys, child * sizeof(int));
+    memcpy(children, inner->children, (child + 1) * sizeof(void *));
+
+    keys[child] = childSeparator;
+    children[child + 1] = childRight;
+
+    memcpy(keys + child + 1, inner->keys + child,
+           (BTREE_ORDER - 1 - child) * sizeof(int));
+    memcpy(children + child + 2, inner->children + child + 1,
+           (BTREE_ORDER - 1 - child) * sizeof(void *));
+
+    btree_inner_t *newInner = btree_make_inner();
+    unsigned int leftSize = (BTREE_ORDER + 1) / 2;
+
+    inner->size = leftSize;
+    memcpy(inner->keys, keys, (leftSize - 1) * sizeof(int));
+    memcpy(inner->children, children, leftSize * sizeof(void *));
+
+    newInner->size = BTREE_ORDER + 1 - leftSize;
+    memcpy(newInner->keys, keys + leftSize,
+           (newInner->size - 1) * sizeof(int));
+    memcpy(newInner->children, children + leftSize,
+           newInner->size * sizeof(void *));
+
+    *separator = keys[leftSize - 1];
+    *right = newInner;
+
+    return BTREE_SPLIT;
+}
+
+static bool btree_remove_from(void *node, unsigned int height, int key) {
+
+    if(height == 0) {
+
+        btree_leaf_t *leaf = node;
+        unsigned int position = btree_lower_bound(leaf->keys, leaf->size, key);
+
+        if(position == leaf->size || leaf->keys[position] != key) {
+            return false;
+        }
+
+        memmove(leaf->keys + position, leaf->keys + position + 1,
+                (leaf->size - position - 1) * sizeof(int));
+
+        --leaf->size;
+
+        return true;
+    }
+
+    btree_inner_t *inner = node;
+    unsigned int child = btree_child(inner, key);
+
+    if(!btree_remove_from(inner->children[child], height - 1, key)) {
+        return false;
+    }
+
+    // Leaves and inner nodes both start with their size.
+    if(*(unsigned int *) inner->children[child] < BTREE_MIN_SIZE) {
+        btree_rebalance(inner, child, height - 1);
+    }
+
+    return true;
+}
+
+static void btree_rebalance(btree_inner_t *parent, unsigned int child,
+                            unsigned int height) {
+
+    // Always work on a pair of adjacent children, left and left + 1.
+    unsigned int left = child > 0 ? child - 1 : child;
+
+    if(height == 0) {
+
+        btree_leaf_t *leftLeaf = parent->children[left];
+        btree_leaf_t *rightLeaf = parent->children[left + 1];
+        unsigned int total = leftLeaf->size + rightLeaf->size;
+
+        if(total <= BTREE_ORDER) {
+
+            memcpy(leftLeaf->keys + leftLeaf->size, rightLeaf->keys,
+                   rightLeaf->size * sizeof(int));
+
+            leftLeaf->size = total;
+            leftLeaf->next = rightLeaf->next;
+
+            arena_free(leaves, rightLeaf);
+
+            btree_remove_child(parent, left);
+
+            return;
+        }
+
+        // Both keep half of the keys, moved across the boundary.
+        int keys[2 * BTREE_ORDER];
+
+        memcpy(keys, leftLeaf->keys, leftLeaf->size * sizeof(int));
+        memcpy(keys + leftLeaf->size, rightLeaf->keys,
+               rightLeaf->size * sizeof(int));
+
+        leftLeaf->size = total / 2;
+        rightLeaf->size = total - leftLeaf->size;
+
+        memcpy(leftLeaf->keys, keys, leftLeaf->size * sizeof(int));
+        memcpy(rightLeaf->keys, keys + leftLeaf->size,
+               rightLeaf->size * sizeof(int));
+
+        parent->keys[left] = rightLeaf->keys[0];
+
+        return;
+    }
+
+    btree_inner_t *leftInner = parent->children[left];
+    btree_inner_t *rightInner = parent->children[left + 1];
+    unsigned int total = leftInner->size + rightInner->size;
+
+    // The separator from the parent goes between the two sets of keys.
+    int keys[2 * BTREE_ORDER];
+    void *children[2 * BTREE_ORDER];
+
+    memcpy(keys, leftInner->keys, (leftInner->size - 1) * sizeof(int));
+    keys[leftInner->size - 1] = parent->keys[left];
+    memcpy(keys + leftInner->size, rightInner->keys,
+           (rightInner->size - 1) * sizeof(int));
+
+    memcpy(children, leftInner->children, leftInner->size * sizeof(void *));
+    memcpy(children + leftInner->size, rightInner->children,
+           rightInner->size * sizeof(void *));
+
+    if(total <= BTREE_ORDER) {
+
+        leftInner->size = total;
+        memcpy(leftInner->keys, keys, (total - 1) * sizeof(int));
+        memcpy(leftInner->children, children, total * sizeof(void *));
+
+        arena_free(inners, rightInner);
+
+        btree_remove_child(parent, left);
+
+        return;
+    }
+
+    leftInner->size = total / 2;
+    rightInner->size = total - leftInner->size;
+
+    memcpy(leftInner->keys, keys, (leftInner->size - 1) * sizeof(int));
+    memcpy(leftInner->children, children, leftInner->size * sizeof(void *));
+
+    parent->keys[left] = keys[leftInner->size - 1];
+
+    memcpy(rightInner->keys, keys + leftInner->size,
+           (rightInner->size - 1) * sizeof(int));
+    memcpy(rightInner->children, children + leftInner->size,
+           rightInner->size * sizeof(void *));
+}
+
+static void btree_remove_child(btree_inner_t *inner, unsigned int separator) {
+
+    memmove(inner->keys + separator, inner->keys + separator + 1,
+            (inner->size - 2 - separator) * sizeof(int));
+    memmove(inner->children + separator + 1, inner->children + separator + 2,
+            (inner->size - 2 - separator) * sizeof(void *));
+
+    --inner->size;
+}
+
+static btree_leaf_t *btree_make_leaf() {
+
+    btree_leaf_t *leaf = arena_alloc(leaves);
+
+    leaf->size = 0;
+    leaf->next = NULL;
+
+    return leaf;
+}
+
+static btree_inner_t *btree_make_inner() {
+
+    btree_inner_t *inner = arena_alloc(inners);
+
+    inner->size = 0;
+
+    return inner;
+}
+
+static void btree_destroy_node(void *node, unsigned int height) {
+
+    if(height > 0) {
+
+        btree_inner_t *inner = node;
+
+        for(unsigned int i = 0; i < inner->size; ++i) {
+            btree_destroy_node(inner->children[i], height - 1);
+        }
+
+        arena_free(inners, node);
+    }
+    else {
+        arena_free(leaves, node);
+    }
+}
@@ -0,0 +1,82 @@
+/**
+ * B+ tree of distinct integers in descending order. Keys are only held
+ * in the leaves, which are chained from the largest keys to the smallest,
+ * so the tree can be read in order one contiguous block at a time.
+ * Insertion and removal take logarithmic time, reading the largest key
+ * takes constant time.
+ * All the trees and their nodes come from shared arenas, one per type, and
+ * freed ones are reused, so they can also be released all at once.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Maximal number of keys in a leaf and of children of an inner node.
+#define BTREE_ORDER 64
+
+// Leaf with keys in descending order, next holds the smaller ones.
+typedef struct btree_leaf_t {
+
+    unsigned int size;
+    int keys[BTREE_ORDER];
+    struct btree_leaf_t *next;
+
+} btree_leaf_t;
+
+// Inner node with size children. All keys under children[i] are greater
+// than keys[i], which is not smaller than any key under children[i + 1].
+typedef struct btree_inner_t {
+
+    unsigned int size;
+    int keys[BTREE_ORDER - 1];
+    void *children[BTREE_ORDER];
+
+} btree_inner_t;
+
+// The tree. The root is a leaf iff the height is zero. The first leaf
+// holds the largest keys and stays the same for the whole life of the tree.
+typedef struct btree_t {
+
+    void *root;
+    unsigned int height;
+    btree_leaf_t *first;
+    size_t size;
+
+} btree_t;
+
+// Makes a new empty tree object.
+btree_t *btree_make();
+
+// Makes a new tree object holding the count keys, given in descending order
+// without repetitions. Takes linear time.
+btree_t *btree_make_sorted(const int *keys, size_t count);
+
+// Inserts the key keeping the order.
+// Returns false and does nothing if the key is already present.
+bool btree_insert(btree_t *tree, int key);
+
+// Removes the key keeping the order.
+// Returns false and does nothing if the key is not present.
+bool btree_remove(btree_t *tree, int key);
+
+// Returns true iff the key is present.
+bool btree_contains(const btree_t *tree, int key);
+
+// Gives the leaf the key is in or would be inserted into. The largest key
+// not greater than the given one is in it or first in the next leaf.
+const btree_leaf_t *btree_find_leaf(const btree_t *tree, int key);
+
+// Gives all the memory held by the tree back for reuse and NULLs the pointer.
+void btree_destroy(btree_t **tree);
+
+// Releases the memory of all the trees at once, without visiting them.
+// All the trees are invalid afterwards and must not be used or destroyed.
+void btree_release_all();
+
+#endif // BTREE_H
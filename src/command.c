@@ -0,0 +1,477 @@
+/**
+ * Implementation of command.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include <string.h>
+#include "command.h"
+#include "defines.h"
+
+// Maximal number of tokens in a correct line.
+#define COMMAND_MAX_TOKENS 3
+
+// Internal auxiliary function returning true iff the token is equal
+// to the null terminated string.
+static bool command_token_equals(const char *token, size_t length,
+                                 const char *string);
+
+// Internal auxiliary function recognising the command name.
+static command_type_t command_get_type(const char *token, size_t length);
+
+// Internal auxiliary function converting an argument token to a number.
+static long command_parse_number(const char *token, size_t length);
+
+// Internal auxiliary function converting an argument to its binary form.
+static uint32_t command_encode_number(long value);
+
+// Internal auxiliary function returning true iff the command takes a list.
+static bool command_is_batch(command_type_t type);
+
+// Internal auxiliary function parsing the text argument of the list at
+// the position and moving the position to the next one.
+static long command_next_list_arg(const char **position, const char *listEnd);
+
+
+command_t command_parse(const char *line, size_t length) {
+
+    command_t command;
+    command.type = COMMAND_INVALID;
+    command.argCount = 0;
+    command.arg1 = -1;
+    command.arg2 = -1;
+    command.path = NULL;
+    command.pathLength = 0;
+    command.listCount = 0;
+    command.list = NULL;
+    command.listLength = 0;
+    command.listBinary = false;
+
+    // Everything after a null character is ignored.
+    const char *terminator = memchr(line, '\0', length);
+
+    if(terminator != NULL) {
+        length = (size_t) (terminator - line);
+    }
+
+    // Empty line or a comment.
+    if(length == 0 || line[0] == '#') {
+
+        command.type = COMMAND_IGNORED;
+
+        return command;
+    }
+
+    const char *tokens[COMMAND_MAX_TOKENS];
+    size_t tokenLengths[COMMAND_MAX_TOKENS];
+    int tokenCount = 0;
+    size_t extraCount = 0;
+
+    const char *position = line;
+    const char *lineEnd = line + length;
+
+    // Split on single spaces. An empty token means there was a leading,
+    // trailing or repeated space.
+    while(true) {
+
+        size_t remaining = (size_t) (lineEnd - position);
+        const char *space = memchr(position, ' ', remaining);
+        const char *tokenEnd = space == NULL ? lineEnd : space;
+
+        if(tokenEnd == position) {
+            return command;
+        }
+
+        if(tokenCount == COMMAND_MAX_TOKENS) {
+
+            // Only batches take more arguments, the remaining ratings
+            // are just counted here and parsed on request.
+            if(extraCount == 0 && !command_is_batch(
+                    command_get_type(tokens[0], tokenLengths[0]))) {
+
+                return command;
+            }
+
+            ++extraCount;
+        }
+        else {
+
+            tokens[tokenCount] = position;
+            tokenLengths[tokenCount] = (size_t) (tokenEnd - position);
+            ++tokenCount;
+        }
+
+        if(space == NULL) {
+            break;
+        }
+
+        position = space + 1;
+    }
+
+    command.argCount = tokenCount - 1;
+
+    if(tokenCount > 1) {
+        command.arg1 = command_parse_number(tokens[1], tokenLengths[1]);
+        command.path = tokens[1];
+        command.pathLength = tokenLengths[1];
+    }
+
+    if(tokenCount > 2) {
+        command.arg2 = command_parse_number(tokens[2], tokenLengths[2]);
+    }
+
+    command.type = command_get_type(tokens[0], tokenLengths[0]);
+
+    // The ratings of a batch are everything after the userID.
+    if(command_is_batch(command.type) && tokenCount == COMMAND_MAX_TOKENS) {
+
+        command.listCount = extraCount + 1;
+        command.list = tokens[2];
+        command.listLength = (size_t) (lineEnd - tokens[2]);
+    }
+
+    return command;
+}
+
+command_t command_decode(const char *record) {
+
+    uint32_t fields[3];
+
+    memcpy(fields, record, COMMAND_RECORD_SIZE);
+
+    command_t command;
+    command.type = COMMAND_INVALID;
+    command.argCount = 2;
+    command.arg1 = fields[1];
+    command.arg2 = fields[2];
+    command.path = NULL;
+    command.pathLength = 0;
+    command.listCount = 0;
+    command.list = NULL;
+    command.listLength = 0;
+    command.listBinary = false;
+
+    switch(fields[0]) {
+
+        case COMMAND_OPCODE_ADD_USER:
+            command.type = COMMAND_ADD_USER;
+            break;
+
+        case COMMAND_OPCODE_DEL_USER:
+            command.type = COMMAND_DEL_USER;
+            command.argCount = 1;
+            break;
+
+        case COMMAND_OPCODE_ADD_MOVIE:
+            command.type = COMMAND_ADD_MOVIE;
+            break;
+
+        case COMMAND_OPCODE_DEL_MOVIE:
+            command.type = COMMAND_DEL_MOVIE;
+            break;
+
+        case COMMAND_OPCODE_MARATHON:
+            command.type = COMMAND_MARATHON;
+            break;
+
+        case COMMAND_OPCODE_ADD_MOVIES:
+            command.type = COMMAND_ADD_MOVIES;
+            break;
+
+        case COMMAND_OPCODE_DEL_MOVIES:
+            command.type = COMMAND_DEL_MOVIES;
+            break;
+
+        case COMMAND_OPCODE_MARATHON_OPEN:
+            command.type = COMMAND_MARATHON_OPEN;
+            command.argCount = 1;
+            break;
+
+        case COMMAND_OPCODE_MARATHON_NEXT:
+            command.type = COMMAND_MARATHON_NEXT;
+            break;
+
+        case COMMAND_OPCODE_MARATHON_CLOSE:
+            command.type = COMMAND_MARATHON_CLOSE;
+            command.argCount = 1;
+            break;
+
+        default:
+            break;
+    }
+
+    if(command_is_batch(command.type)) {
+
+        command.listCount = fields[2];
+        command.listLength = command.listCount * COMMAND_LIST_ARG_SIZE;
+        command.listBinary = true;
+    }
+
+    return command;
+}
+
+void command_get_list(command_t command, long *args) {
+
+    NNULL(command.list, "command_get_list");
+
+    if(command.listBinary) {
+
+        for(size_t i = 0; i < command.listCount; ++i) {
+
+            uint32_t value;
+
+            memcpy(&value, command.list + i * COMMAND_LIST_ARG_SIZE,
+                   COMMAND_LIST_ARG_SIZE);
+
+            args[i] = value;
+        }
+
+        return;
+    }
+
+    const char *position = command.list;
+    const char *listEnd = command.list + command.listLength;
+
+    for(size_t i = 0; i < command.listCount; ++i) {
+        args[i] = command_next_list_arg(&position, listEnd);
+    }
+}
+
+bool command_encode(command_t command, char *record) {
+
+    uint32_t fields[3];
+
+    fields[0] = COMMAND_OPCODE_INVALID;
+    fields[1] = command_encode_number(command.arg1);
+    fields[2] = command_encode_number(command.arg2);
+
+    switch(command.type) {
+
+        case COMMAND_IGNORED:
+            return false;
+
+        case COMMAND_ADD_USER:
+            fields[0] = COMMAND_OPCODE_ADD_USER;
+            break;
+
+        case COMMAND_DEL_USER:
+
+            // Only a single argument is allowed.
+            if(command.argCount <= 1) {
+                fields[0] = COMMAND_OPCODE_DEL_USER;
+                fields[2] = 0;
+            }
+
+            break;
+
+        case COMMAND_ADD_MOVIE:
+            fields[0] = COMMAND_OPCODE_ADD_MOVIE;
+            break;
+
+        case COMMAND_DEL_MOVIE:
+            fields[0] = COMMAND_OPCODE_DEL_MOVIE;
+            break;
+
+        case COMMAND_MARATHON:
+            fields[0] = COMMAND_OPCODE_MARATHON;
+            break;
+
+        // A batch without ratings is only an invalid record, its
+        // payload is written separately.
+        case COMMAND_ADD_MOVIES:
+        case COMMAND_DEL_MOVIES:
+
+            if(command.listCount > 0 &&
+               command.listCount < COMMAND_RECORD_ARG_INVALID) {
+
+                fields[0] = command.type == COMMAND_ADD_MOVIES ?
+                            COMMAND_OPCODE_ADD_MOVIES :
+                            COMMAND_OPCODE_DEL_MOVIES;
+                fields[2] = (uint32_t) command.listCount;
+            }
+
+            break;
+
+        case COMMAND_MARATHON_OPEN:
+        case COMMAND_MARATHON_CLOSE:
+
+            // Only a single argument is allowed.
+            if(command.argCount <= 1) {
+                fields[0] = command.type == COMMAND_MARATHON_OPEN ?
+                            COMMAND_OPCODE_MARATHON_OPEN :
+                            COMMAND_OPCODE_MARATHON_CLOSE;
+                fields[2] = 0;
+            }
+
+            break;
+
+        case COMMAND_MARATHON_NEXT:
+            fields[0] = COMMAND_OPCODE_MARATHON_NEXT;
+            break;
+
+        case COMMAND_SAVE:
+        case COMMAND_LOAD:
+        case COMMAND_STATS:
+        case COMMAND_INVALID:
+            break;
+    }
+
+    memcpy(record, fields, COMMAND_RECORD_SIZE);
+
+    return true;
+}
+
+void command_encode_list(command_t command, char *payload) {
+
+    const char *position = command.list;
+    const char *listEnd = command.list + command.listLength;
+
+    for(size_t i = 0; i < command.listCount; ++i) {
+
+        uint32_t value = command_encode_number(
+                command_next_list_arg(&position, listEnd));
+
+        memcpy(payload + i * COMMAND_LIST_ARG_SIZE, &value,
+               COMMAND_LIST_ARG_SIZE);
+    }
+}
+
+static bool command_token_equals(const char *token, size_t length,
+                                 const char *string) {
+
+    return length == strlen(string) && memcmp(token, string, length) == 0;
+}
+
+static command_type_t command_get_type(const char *token, size_t length) {
+
+    switch(token[0]) {
+
+        case 'a':
+
+            if(command_token_equals(token, length, CTRL_STR_ADDUSER)) {
+                return COMMAND_ADD_USER;
+            }
+
+            if(command_token_equals(token, length, CTRL_STR_ADDMOVIE)) {
+                return COMMAND_ADD_MOVIE;
+            }
+
+            if(command_token_equals(token, length, CTRL_STR_ADDMOVIES)) {
+                return COMMAND_ADD_MOVIES;
+            }
+
+            break;
+
+        case 'd':
+
+            if(command_token_equals(token, length, CTRL_STR_DELUSER)) {
+                return COMMAND_DEL_USER;
+            }
+
+            if(command_token_equals(token, length, CTRL_STR_DELMOVIE)) {
+                return COMMAND_DEL_MOVIE;
+            }
+
+            if(command_token_equals(token, length, CTRL_STR_DELMOVIES)) {
+                return COMMAND_DEL_MOVIES;
+            }
+
+            break;
+
+        case 'm':
+
+            if(command_token_equals(token, length, CTRL_STR_MARATHON)) {
+                return COMMAND_MARATHON;
+            }
+
+            if(command_token_equals(token, length, CTRL_STR_MARATHONOPEN)) {
+                return COMMAND_MARATHON_OPEN;
+            }
+
+            if(command_token_equals(token, length, CTRL_STR_MARATHONNEXT)) {
+                return COMMAND_MARATHON_NEXT;
+            }
+
+            if(command_token_equals(token, length, CTRL_STR_MARATHONCLOSE)) {
+                return COMMAND_MARATHON_CLOSE;
+            }
+
+            break;
+
+        case 'l':
+
+            if(command_token_equals(token, length, CTRL_STR_LOAD)) {
+                return COMMAND_LOAD;
+            }
+
+            break;
+
+        case 's':
+
+            if(command_token_equals(token, length, CTRL_STR_SAVE)) {
+                return COMMAND_SAVE;
+            }
+
+            if(command_token_equals(token, length, CTRL_STR_STATS)) {
+                return COMMAND_STATS;
+            }
+
+            break;
+
+        default:
+            break;
+    }
+
+    return COMMAND_INVALID;
+}
+
+static long command_parse_number(const char *token, size_t length) {
+
+    // Only tokens starting with a digit are numbers.
+    if(token[0] < '0' || token[0] > '9') {
+        return -1;
+    }
+
+    long value = 0;
+
+    // Only the leading digits are taken into account.
+    for(size_t i = 0; i < length && token[i] >= '0' && token[i] <= '9'; ++i) {
+
+        long digit = token[i] - '0';
+
+        if(value > (COMMAND_ARG_MAX - digit) / 10) {
+            return COMMAND_ARG_MAX;
+        }
+
+        value = 10 * value + digit;
+    }
+
+    return value;
+}
+
+static uint32_t command_encode_number(long value) {
+
+    if(value < 0 || value >= (long) COMMAND_RECORD_ARG_INVALID) {
+        return COMMAND_RECORD_ARG_INVALID;
+    }
+
+    return (uint32_t) value;
+}
+
+static bool command_is_batch(command_type_t type) {
+
+    return type == COMMAND_ADD_MOVIES || type == COMMAND_DEL_MOVIES;
+}
+
+static long command_next_list_arg(const char **position, const char *listEnd) {
+
+    const char *space = memchr(*position, ' ', (size_t) (listEnd - *position));
+    const char *tokenEnd = space == NULL ? listEnd : space;
+
+    long value = command_parse_number(*position,
+                                      (size_t) (tokenEnd - *position));
+
+    *position = tokenEnd + 1;
+
+    return value;
+}
@@ -0,0 +1,129 @@
+/**
+ * Parsing of the input commands. A line is split into the command and its
+ * arguments in a single pass, without copying or modifying it.
+ * The accepted format is exactly the one of the specification: at most three
+ * tokens separated by single spaces, with no leading or trailing whitespace.
+ * The batch commands take any number of ratings after the userID, which
+ * are left in the line and only parsed on request.
+ * A line ends at the first null character, if there is one.
+ * Commands can also be given as fixed-width binary records: an opcode
+ * and two arguments, each a 32-bit unsigned integer in the byte order
+ * of the machine. A batch record has the userID and the number of ratings
+ * as its arguments and is followed by the ratings, one 32-bit unsigned
+ * integer each.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Kinds of input lines.
+typedef enum command_type_t {
+
+    // Empty lines and comments, they produce no output.
+    COMMAND_IGNORED,
+
+    // Lines that are not correctly formed or name an unknown command.
+    COMMAND_INVALID,
+
+    COMMAND_ADD_USER,
+    COMMAND_DEL_USER,
+    COMMAND_ADD_MOVIE,
+    COMMAND_DEL_MOVIE,
+    COMMAND_MARATHON,
+
+    // Batches of addMovie and delMovie of a single user.
+    COMMAND_ADD_MOVIES,
+    COMMAND_DEL_MOVIES,
+
+    // Marathons read in parts through cursors.
+    COMMAND_MARATHON_OPEN,
+    COMMAND_MARATHON_NEXT,
+    COMMAND_MARATHON_CLOSE,
+
+    COMMAND_SAVE,
+    COMMAND_LOAD,
+
+    // Prints the statistics, only known if they are compiled in.
+    COMMAND_STATS
+
+} command_type_t;
+
+// A parsed line. Arguments that are missing or do not start with a digit
+// are -1, ones that do are the value of their leading digits, saturated
+// at COMMAND_ARG_MAX. The first argument is also given as text, pointing
+// into the line, for the commands taking a path.
+// The ratings of a batch are its list: the text after the userID or the
+// payload of the binary record, which the reader has to set.
+typedef struct command_t {
+
+    command_type_t type;
+    int argCount;
+    long arg1;
+    long arg2;
+    const char *path;
+    size_t pathLength;
+
+    size_t listCount;
+    const char *list;
+    size_t listLength;
+    bool listBinary;
+
+} command_t;
+
+// Value of arguments too big to be represented.
+#define COMMAND_ARG_MAX LONG_MAX
+
+// Size of a binary record in bytes.
+#define COMMAND_RECORD_SIZE (3 * sizeof(uint32_t))
+
+// Size of a single rating in the payload of a binary batch record.
+#define COMMAND_LIST_ARG_SIZE sizeof(uint32_t)
+
+// Opcodes of the binary records. Any other opcode is an invalid command.
+#define COMMAND_OPCODE_INVALID 0
+#define COMMAND_OPCODE_ADD_USER 1
+#define COMMAND_OPCODE_DEL_USER 2
+#define COMMAND_OPCODE_ADD_MOVIE 3
+#define COMMAND_OPCODE_DEL_MOVIE 4
+#define COMMAND_OPCODE_MARATHON 5
+#define COMMAND_OPCODE_ADD_MOVIES 6
+#define COMMAND_OPCODE_DEL_MOVIES 7
+#define COMMAND_OPCODE_MARATHON_OPEN 8
+#define COMMAND_OPCODE_MARATHON_NEXT 9
+#define COMMAND_OPCODE_MARATHON_CLOSE 10
+
+// Binary argument standing for a missing or out of range one.
+#define COMMAND_RECORD_ARG_INVALID UINT32_MAX
+
+// Parses the line of given length, not including the newline.
+command_t command_parse(const char *line, size_t length);
+
+// Decodes the binary record of COMMAND_RECORD_SIZE bytes. The list
+// of a batch is left NULL, its payload follows the record.
+command_t command_decode(const char *record);
+
+// Writes the listCount arguments of the list to args, the same way as the
+// fixed ones.
+void command_get_list(command_t command, long *args);
+
+// Encodes the command into a binary record of COMMAND_RECORD_SIZE bytes,
+// decoded to a command with the same outcome. Arguments that do not fit
+// become COMMAND_RECORD_ARG_INVALID. Commands without a binary form
+// (save, load and stats) become invalid records. Returns false and does
+// nothing for ignored lines.
+// The payload of a batch, listCount times COMMAND_LIST_ARG_SIZE bytes,
+// is written by command_encode_list.
+bool command_encode(command_t command, char *record);
+
+// Encodes the list of the batch into its binary payload.
+void command_encode_list(command_t command, char *payload);
+
+#endif // COMMAND_H
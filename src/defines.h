@@ -18,18 +18,31 @@
 #define CTRL_STR_DELUSER "delUser"
 #define CTRL_STR_ADDMOVIE "addMovie"
 #define CTRL_STR_DELMOVIE "delMovie"
+#define CTRL_STR_ADDMOVIES "addMovies"
+#define CTRL_STR_DELMOVIES "delMovies"
 #define CTRL_STR_MARATHON "marathon"
+#define CTRL_STR_MARATHONOPEN "marathonOpen"
+#define CTRL_STR_MARATHONNEXT "marathonNext"
+#define CTRL_STR_MARATHONCLOSE "marathonClose"
+#define CTRL_STR_SAVE "save"
+#define CTRL_STR_LOAD "load"
+#define CTRL_STR_STATS "stats"
 
 // Messages generated by the program.
 #define ERROR_MSG "ERROR\n"
 #define OK_MSG "OK\n"
 #define EMPTY_LIST_MSG "NONE\n"
 
-// Initial size of the input buffer.
-#define INITIAL_BUFFER_SIZE 32
+// Responses of the binary protocol, 32-bit unsigned integers. A marathon
+// answers with the number of movies followed by the movies. A batch
+// answers with OK followed by a bitmap of the ratings it applied, bit i
+// of word i / 32 for the i-th one.
+#define BINARY_OK_MSG 0
+#define BINARY_ERROR_MSG 0xFFFFFFFF
 
-// Maximal userID.
-#define MAX_USER 65535
+// Maximal userID. All ones is reserved as the marker of missing
+// identifiers and invalid binary arguments.
+#define MAX_USER 4294967294
 
 // Maximal movieRating.
 #define MAX_MOVIE 2147483647
@@ -37,6 +50,27 @@
 // Maximal marathon length.
 #define MAX_MARATHON 2147483647
 
+// Maximal number of ratings in a single addMovies or delMovies.
+#define MAX_MOVIE_BATCH 1048576
+
+// Maximal number of marathon cursors open at the same time.
+#define MAX_CURSORS 65536
+
+// Maximal number of threads evaluating marathons.
+#define MAX_THREADS 256
+
+// Default number of operations and milliseconds after which
+// the logged operations are committed together.
+#define LOG_GROUP_SIZE 1024
+#define LOG_GROUP_TIME 100
+
+// Maximal number of consecutive marathons answered together.
+#define MARATHON_BATCH_SIZE 256
+
+// Maximal number of commands of a single client of the server
+// performed before the other clients get their turn.
+#define SERVER_TURN_SIZE 256
+
 // Macros asserting that the passed pointer is or is not NULL.
 #ifndef NDEBUG
 
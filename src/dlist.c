@@ -7,63 +7,47 @@
 #include "dlist.h"
 #include "defines.h"
 
-dlist_t *dlist_make_list() {
+// Internal function linking the unlinked node between two adjacent ones.
+static void dlist_link(dnode_t *prev, dnode_t *node, dnode_t *next);
 
-    dlist_t *list = malloc(sizeof(dlist_t));
 
-    // Assure that malloc has not failed.
-    NNULL(list, "dlist_make_list");
+void dlist_init(dlist_t *list) {
 
-    list->head = dlist_make_node(NULL, dlist_make_elem_ptr(NULL), NULL);
-    list->tail = dlist_make_node(list->head, dlist_make_elem_ptr(NULL), NULL);
-    list->head->next = list->tail;
+    NNULL(list, "dlist_init");
 
-    return list;
+    list->head.prev = NULL;
+    list->head.next = &list->tail;
+    list->tail.prev = &list->head;
+    list->tail.next = NULL;
 }
 
-dnode_t *dlist_make_node(dnode_t *prev, dlist_elem_t elem, dnode_t *next) {
+void dlist_init_node(dnode_t *node) {
 
-    dnode_t *node = malloc(sizeof(dnode_t));
-
-    // Assure that malloc has not failed.
-    NNULL(node, "dlist_make_node");
-
-    node->prev = prev;
-    node->elem = elem;
-    node->next = next;
-
-    return node;
-}
-
-dlist_elem_t dlist_make_elem_ptr(void *ptr) {
-
-    dlist_elem_t elem;
-    elem.ptr = ptr;
-
-    return elem;
+    NNULL(node, "dlist_init_node");
 
+    node->prev = NULL;
+    node->next = NULL;
 }
 
-dlist_elem_t dlist_make_elem_num(long num) {
+bool dlist_is_empty(dlist_t *list) {
 
-    dlist_elem_t elem;
-    elem.num = num;
+    NNULL(list, "dlist_is_empty");
 
-    return elem;
+    return list->head.next == &list->tail;
 }
 
 dnode_t *dlist_get_front(dlist_t *list) {
 
     NNULL(list, "dlist_get_front");
 
-    return dlist_is_valid(list->head->next) ? list->head->next : NULL;
+    return dlist_is_valid(list->head.next) ? list->head.next : NULL;
 }
 
 dnode_t *dlist_get_back(dlist_t *list) {
 
     NNULL(list, "dlist_get_back");
 
-    return dlist_is_valid(list->tail->prev) ? list->tail->prev : NULL;
+    return dlist_is_valid(list->tail.prev) ? list->tail.prev : NULL;
 }
 
 bool dlist_is_valid(dnode_t *iter) {
@@ -78,25 +62,33 @@ dnode_t *dlist_next(dnode_t *iter) {
     return dlist_is_valid(iter->next) ? iter->next : NULL;
 }
 
-void dlist_push_back(dlist_t *list, dlist_elem_t elem) {
+dnode_t *dlist_prev(dnode_t *iter) {
+
+    NNULL(iter, "dlist_prev");
+
+    return dlist_is_valid(iter->prev) ? iter->prev : NULL;
+}
+
+void dlist_push_back(dlist_t *list, dnode_t *node) {
 
     NNULL(list, "list/dlist_push_back");
-    NNULL(list->tail, "tail/dlist_push_back");
 
-    dlist_insert_after(list->tail->prev, elem);
+    dlist_link(list->tail.prev, node, &list->tail);
 }
 
-void dlist_insert_after(dnode_t *iter, dlist_elem_t elem) {
+void dlist_push_front(dlist_t *list, dnode_t *node) {
 
-    NNULL(iter, "iter/dlist_insert_after");
-    NNULL(iter->next, "next/dlist_insert_after");
+    NNULL(list, "list/dlist_push_front");
 
-    dnode_t *oldNext = iter->next;
+    dlist_link(&list->head, node, list->head.next);
+}
 
-    dnode_t *newNode = dlist_make_node(iter, elem, oldNext);
+void dlist_insert_after(dnode_t *iter, dnode_t *node) {
+
+    NNULL(iter, "iter/dlist_insert_after");
+    NNULL(iter->next, "next/dlist_insert_after");
 
-    iter->next = newNode;
-    oldNext->prev = newNode;
+    dlist_link(iter, node, iter->next);
 }
 
 void dlist_insert_node_after(dnode_t *iter, dnode_t *other) {
@@ -105,20 +97,10 @@ void dlist_insert_node_after(dnode_t *iter, dnode_t *other) {
     NNULL(other->next, "othernext/dlist_insert_node_after");
     NNULL(other->prev, "otherprev/dlist_insert_node_after");
 
-    if(other != iter->next) {
-
-        dnode_t *oldIterNext = iter->next;
-        dnode_t *oldOtherNext = other->next;
-        dnode_t *oldOtherPrev = other->prev;
-
-        oldOtherPrev->next = oldOtherNext;
-        oldOtherNext->prev = oldOtherPrev;
+    if(other != iter->next && other != iter) {
 
-        oldIterNext->prev = other;
-        iter->next = other;
-
-        other->prev = iter;
-        other->next = oldIterNext;
+        dlist_remove(other);
+        dlist_link(iter, other, iter->next);
     }
 }
 
@@ -127,8 +109,6 @@ void dlist_insert_list_after(dnode_t *iter, dlist_t *other) {
     NNULL(iter, "iter/dlist_insert_list_after");
     NNULL(other, "other/dlist_insert_list_after");
     NNULL(iter->next, "next/dlist_insert_list_after");
-    NNULL(other->head, "head/dlist_insert_list_after");
-    NNULL(other->tail, "tail/dlist_insert_list_after");
 
     dnode_t *otherFront = dlist_get_front(other);
     dnode_t *otherBack = dlist_get_back(other);
@@ -146,8 +126,7 @@ void dlist_insert_list_after(dnode_t *iter, dlist_t *other) {
     oldNext->prev = otherBack;
     otherBack->next = oldNext;
 
-    other->head->next = NULL;
-    other->tail->prev = NULL;
+    dlist_init(other);
 }
 
 void dlist_remove(dnode_t *iter) {
@@ -159,55 +138,45 @@ void dlist_remove(dnode_t *iter) {
     iter->next->prev = iter->prev;
     iter->prev->next = iter->next;
 
-    // Note that the lem is not managed by us and is not freed.
-
-    free(iter);
+    // Note that the record holding the node is not managed by us
+    // and is not freed.
+    iter->prev = NULL;
+    iter->next = NULL;
 }
 
-void dlist_pop_back(dlist_t *list) {
+dnode_t *dlist_pop_back(dlist_t *list) {
 
     NNULL(list, "list/dlist_pop_back");
-    NNULL(list->tail, "tail/dlist_pop_back");
-
-    if(dlist_is_valid(list->tail->prev)) {
-        dlist_remove(list->tail->prev);
-    }
-}
-
-void dlist_print_num(dlist_t *list) {
-
-    NNULL(list, "print_list");
 
-    dnode_t *iter = dlist_get_front(list);
+    dnode_t *back = dlist_get_back(list);
 
-    if(iter == NULL) {
+    if(back != NULL) {
+        dlist_remove(back);
+    }
 
-        printf(EMPTY_LIST_MSG);
+    return back;
+}
 
-        return;
-    }
+dnode_t *dlist_pop_front(dlist_t *list) {
 
-    while(dlist_next(iter) != NULL) {
+    NNULL(list, "list/dlist_pop_front");
 
-        printf("%ld ", iter->elem.num);
+    dnode_t *front = dlist_get_front(list);
 
-        iter = dlist_next(iter);
+    if(front != NULL) {
+        dlist_remove(front);
     }
 
-    printf("%ld\n", iter->elem.num);
+    return front;
 }
 
-void dlist_destroy(dlist_t **list) {
+static void dlist_link(dnode_t *prev, dnode_t *node, dnode_t *next) {
 
-    NNULL(*list, "dlist_destroy");
+    NNULL(node, "node/dlist_link");
 
-    while(dlist_get_back(*list) != NULL) {
-        dlist_pop_back(*list);
-    }
-
-    free((*list)->head);
-    free((*list)->tail);
-    free(*list);
+    node->prev = prev;
+    node->next = next;
 
-    *list = NULL;
-}
\ No newline at end of file
+    prev->next = node;
+    next->prev = node;
+}
@@ -1,7 +1,11 @@
 /**
- * Doubly linked list data structure.
- * All operations with the exception of dlist_destroy and dlist_print_num
- * take constant time.
+ * Intrusive doubly linked list data structure.
+ * The links are a dnode_t embedded in the element record, so the list never
+ * allocates: putting an element on a list or taking it off only rewires
+ * pointers, and the record is released together with its links.
+ * The head and tail sentinels are embedded in the dlist_t itself, so a list
+ * can live inside another record, but must not be moved once initialised.
+ * All operations take constant time.
  *
  * Author: Mateusz Gienieczko
  * Copyright (C) 2018
@@ -11,46 +15,38 @@
 #define DLIST_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
-// Elements held in the list - longs or pointers.
-typedef union dlist_elem_t {
+// Gives the record of the given type containing the node as its member.
+#define DLIST_ENTRY(node, type, member) \
+    ((type *) ((char *) (node) - offsetof(type, member)))
 
-    void *ptr;
-    long num;
-
-} dlist_elem_t;
-
-// Doubly linked list generic node holding elem_t type elements.
+// Links of a single element, embedded in its record.
+// Both are NULL iff the element is not on any list.
 typedef struct dnode_t {
 
-    dlist_elem_t elem;
     struct dnode_t *prev;
     struct dnode_t *next;
 
 } dnode_t;
 
-// A list is a head and a tail. Both head and tail must be always not NULL.
-// Head and tail are dummy nodes.
-// They are the only elements that can contain a NULL as next or prev.
+// A list is a head and a tail, both dummy nodes embedded in the list.
+// They are the only nodes on the list that contain a NULL as prev or next.
 typedef struct dlist_t {
 
-    dnode_t *head;
-    dnode_t *tail;
+    dnode_t head;
+    dnode_t tail;
 
 } dlist_t;
 
-// Makes a new empty list object. Always takes at least 2 * sizeof(dnode_t)
-// memory for dummy objects.
-dlist_t *dlist_make_list();
+// Makes the list empty. Any elements still on it are forgotten.
+void dlist_init(dlist_t *list);
 
-// Makes a new node object.
-dnode_t *dlist_make_node(dnode_t *prev, dlist_elem_t elem, dnode_t *next);
+// Makes the node unlinked, to be done before it is first used.
+void dlist_init_node(dnode_t *node);
 
-// Makes a new dlist_elem_t object with passed pointer as value ptr.
-dlist_elem_t dlist_make_elem_ptr(void *ptr);
-
-// Makes a new dlist_elem_t object with passed integer as value num.
-dlist_elem_t dlist_make_elem_num(long num);
+// Returns true iff the list has no elements.
+bool dlist_is_empty(dlist_t *list);
 
 // Returns the actual first element of the list (not dummy).
 // NULL if list is empty.
@@ -67,12 +63,19 @@ bool dlist_is_valid(dnode_t *iter);
 // (ignores dummies).
 dnode_t *dlist_next(dnode_t *iter);
 
-// Creates a new node with passed value and adds it at the end of the list.
-void dlist_push_back(dlist_t *list, dlist_elem_t elem);
+// Returns the element before iter or NULL if it is the first element
+// (ignores dummies).
+dnode_t *dlist_prev(dnode_t *iter);
 
-// Creates a new node after the passed one.
+// Adds the unlinked node at the end of the list.
+void dlist_push_back(dlist_t *list, dnode_t *node);
+
+// Adds the unlinked node at the beginning of the list.
+void dlist_push_front(dlist_t *list, dnode_t *node);
+
+// Links the unlinked node after the passed one.
 // The passed node has to be not the tail.
-void dlist_insert_after(dnode_t *iter, dlist_elem_t elem);
+void dlist_insert_after(dnode_t *iter, dnode_t *node);
 
 // Removes the other node from its list and inserts after iter.
 // The iter has to be not the tail.
@@ -85,21 +88,17 @@ void dlist_insert_node_after(dnode_t *iter, dnode_t *other);
 // Other has to be a correct list.
 void dlist_insert_list_after(dnode_t *iter, dlist_t *other);
 
-// Removes the node from the list. It has to be a valid, non-dummy node.
+// Unlinks the node from the list. It has to be a valid, non-dummy node.
+// The record holding it is not released.
 void dlist_remove(dnode_t *iter);
 
-// Removes the last element (ignores dummies).
-// Does nothing if the list is empty.
-void dlist_pop_back(dlist_t *list);
-
-// Prints the list assuming it contains integers.
-// Ends with a newline.
-// Prints EMPTY_LIST_MSG from defines.h if it is empty.
-void dlist_print_num(dlist_t *list);
+// Unlinks and returns the last element (ignores dummies).
+// Does nothing and returns NULL if the list is empty.
+dnode_t *dlist_pop_back(dlist_t *list);
 
-// Destroys all elements on the list.
-// Warning: does not release any resources contained in ptr elements.
-void dlist_destroy(dlist_t **list);
+// Unlinks and returns the first element (ignores dummies).
+// Does nothing and returns NULL if the list is empty.
+dnode_t *dlist_pop_front(dlist_t *list);
 
 
 #endif // DLIST_H
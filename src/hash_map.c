@@ -0,0 +1,181 @@
+/**
+ * Implementation of hash_map.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include "hash_map.h"
+#include "defines.h"
+
+// Capacity of the map after the first insertion.
+#define HASH_MAP_INITIAL_CAPACITY 16
+
+// Internal auxiliary function returning the home slot of the key.
+static size_t hash_map_slot(hash_map_t *map, unsigned int key);
+
+// Internal auxiliary function doubling the capacity and rehashing.
+static void hash_map_grow(hash_map_t *map);
+
+
+hash_map_t *hash_map_make() {
+
+    hash_map_t *map = malloc(sizeof(hash_map_t));
+
+    // Assure that malloc has not failed.
+    NNULL(map, "hash_map_make");
+
+    map->slots = NULL;
+    map->size = 0;
+    map->capacity = 0;
+
+    return map;
+}
+
+unsigned int hash_map_get(hash_map_t *map, unsigned int key) {
+
+    NNULL(map, "hash_map_get");
+
+    if(map->capacity == 0) {
+        return HASH_MAP_MISSING;
+    }
+
+    size_t mask = map->capacity - 1;
+    size_t slot = hash_map_slot(map, key);
+
+    while(map->slots[slot].key != HASH_MAP_MISSING) {
+
+        if(map->slots[slot].key == key) {
+            return map->slots[slot].value;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return HASH_MAP_MISSING;
+}
+
+bool hash_map_insert(hash_map_t *map, unsigned int key, unsigned int value) {
+
+    NNULL(map, "hash_map_insert");
+
+    // Keep the load factor at most one half.
+    if(2 * (map->size + 1) > map->capacity) {
+        hash_map_grow(map);
+    }
+
+    size_t mask = map->capacity - 1;
+    size_t slot = hash_map_slot(map, key);
+
+    while(map->slots[slot].key != HASH_MAP_MISSING) {
+
+        if(map->slots[slot].key == key) {
+            return false;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    map->slots[slot].key = key;
+    map->slots[slot].value = value;
+    ++map->size;
+
+    return true;
+}
+
+bool hash_map_remove(hash_map_t *map, unsigned int key) {
+
+    NNULL(map, "hash_map_remove");
+
+    if(map->capacity == 0) {
+        return false;
+    }
+
+    size_t mask = map->capacity - 1;
+    size_t slot = hash_map_slot(map, key);
+
+    while(map->slots[slot].key != key) {
+
+        if(map->slots[slot].key == HASH_MAP_MISSING) {
+            return false;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    // Shift back the following entries of the cluster that would
+    // become unreachable, so no tombstones are needed.
+    size_t hole = slot;
+    size_t next = (slot + 1) & mask;
+
+    while(map->slots[next].key != HASH_MAP_MISSING) {
+
+        size_t home = hash_map_slot(map, map->slots[next].key);
+
+        // Move the entry if its home is not in the (hole, next] range.
+        if(((next - home) & mask) >= ((next - hole) & mask)) {
+
+            map->slots[hole] = map->slots[next];
+            hole = next;
+        }
+
+        next = (next + 1) & mask;
+    }
+
+    map->slots[hole].key = HASH_MAP_MISSING;
+    --map->size;
+
+    return true;
+}
+
+void hash_map_clear(hash_map_t *map) {
+
+    NNULL(map, "hash_map_clear");
+
+    for(size_t i = 0; i < map->capacity; ++i) {
+        map->slots[i].key = HASH_MAP_MISSING;
+    }
+
+    map->size = 0;
+}
+
+void hash_map_destroy(hash_map_t **map) {
+
+    NNULL(*map, "hash_map_destroy");
+
+    free((*map)->slots);
+    free(*map);
+
+    *map = NULL;
+}
+
+static size_t hash_map_slot(hash_map_t *map, unsigned int key) {
+
+    // Fibonacci hashing spreads consecutive identifiers over the whole table.
+    unsigned long hash = (unsigned long) key * 11400714819323198485ul;
+
+    return (size_t) (hash >> 32) & (map->capacity - 1);
+}
+
+static void hash_map_grow(hash_map_t *map) {
+
+    hash_map_entry_t *oldSlots = map->slots;
+    size_t oldCapacity = map->capacity;
+
+    map->capacity = oldCapacity == 0 ? HASH_MAP_INITIAL_CAPACITY
+                                     : 2 * oldCapacity;
+    map->slots = malloc(map->capacity * sizeof(hash_map_entry_t));
+
+    // Assure that malloc has not failed.
+    NNULL(map->slots, "hash_map_grow");
+
+    hash_map_clear(map);
+
+    for(size_t i = 0; i < oldCapacity; ++i) {
+
+        if(oldSlots[i].key != HASH_MAP_MISSING) {
+            hash_map_insert(map, oldSlots[i].key, oldSlots[i].value);
+        }
+    }
+
+    free(oldSlots);
+}
@@ -0,0 +1,60 @@
+/**
+ * Hash map from unsigned ints to unsigned ints with open addressing
+ * and linear probing. Keys and values are stored side by side, so a lookup
+ * usually touches a single cache line.
+ * Insertion, removal and lookup take expected constant time.
+ * HASH_MAP_MISSING is reserved as the empty slot marker and cannot be
+ * used as a key.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef HASH_MAP_H
+#define HASH_MAP_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Returned by lookups of keys which are not in the map.
+#define HASH_MAP_MISSING UINT_MAX
+
+// A single slot of the map, unused if the key is HASH_MAP_MISSING.
+typedef struct hash_map_entry_t {
+
+    unsigned int key;
+    unsigned int value;
+
+} hash_map_entry_t;
+
+// Map with distinct keys. The capacity is always a power of two.
+typedef struct hash_map_t {
+
+    hash_map_entry_t *slots;
+    size_t size;
+    size_t capacity;
+
+} hash_map_t;
+
+// Makes a new empty map object.
+hash_map_t *hash_map_make();
+
+// Returns the value of the key or HASH_MAP_MISSING if it is not in the map.
+unsigned int hash_map_get(hash_map_t *map, unsigned int key);
+
+// Adds the key with the given value to the map.
+// Returns false and does nothing if the key is already present.
+bool hash_map_insert(hash_map_t *map, unsigned int key, unsigned int value);
+
+// Removes the key from the map.
+// Returns false and does nothing if it is not present.
+bool hash_map_remove(hash_map_t *map, unsigned int key);
+
+// Removes all the keys, keeping the memory for reuse.
+void hash_map_clear(hash_map_t *map);
+
+// Releases all the memory held by the map and NULLs the pointer.
+void hash_map_destroy(hash_map_t **map);
+
+#endif // HASH_MAP_H
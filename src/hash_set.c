@@ -0,0 +1,177 @@
+/**
+ * Implementation of hash_set.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include <limits.h>
+#include "hash_set.h"
+#include "defines.h"
+
+// Marker of an unused slot.
+#define HASH_SET_EMPTY LONG_MIN
+
+// Capacity of the set after the first insertion.
+#define HASH_SET_INITIAL_CAPACITY 16
+
+// Internal auxiliary function returning the home slot of the value.
+static size_t hash_set_slot(hash_set_t *set, long value);
+
+// Internal auxiliary function doubling the capacity and rehashing.
+static void hash_set_grow(hash_set_t *set);
+
+
+hash_set_t *hash_set_make() {
+
+    hash_set_t *set = malloc(sizeof(hash_set_t));
+
+    // Assure that malloc has not failed.
+    NNULL(set, "hash_set_make");
+
+    set->slots = NULL;
+    set->size = 0;
+    set->capacity = 0;
+
+    return set;
+}
+
+bool hash_set_contains(hash_set_t *set, long value) {
+
+    NNULL(set, "hash_set_contains");
+
+    if(set->capacity == 0) {
+        return false;
+    }
+
+    size_t mask = set->capacity - 1;
+    size_t slot = hash_set_slot(set, value);
+
+    while(set->slots[slot] != HASH_SET_EMPTY) {
+
+        if(set->slots[slot] == value) {
+            return true;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return false;
+}
+
+bool hash_set_insert(hash_set_t *set, long value) {
+
+    NNULL(set, "hash_set_insert");
+
+    // Keep the load factor at most one half.
+    if(2 * (set->size + 1) > set->capacity) {
+        hash_set_grow(set);
+    }
+
+    size_t mask = set->capacity - 1;
+    size_t slot = hash_set_slot(set, value);
+
+    while(set->slots[slot] != HASH_SET_EMPTY) {
+
+        if(set->slots[slot] == value) {
+            return false;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    set->slots[slot] = value;
+    ++set->size;
+
+    return true;
+}
+
+bool hash_set_remove(hash_set_t *set, long value) {
+
+    NNULL(set, "hash_set_remove");
+
+    if(set->capacity == 0) {
+        return false;
+    }
+
+    size_t mask = set->capacity - 1;
+    size_t slot = hash_set_slot(set, value);
+
+    while(set->slots[slot] != value) {
+
+        if(set->slots[slot] == HASH_SET_EMPTY) {
+            return false;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    // Shift back the following elements of the cluster that would
+    // become unreachable, so no tombstones are needed.
+    size_t hole = slot;
+    size_t next = (slot + 1) & mask;
+
+    while(set->slots[next] != HASH_SET_EMPTY) {
+
+        size_t home = hash_set_slot(set, set->slots[next]);
+
+        // Move the element if its home is not in the (hole, next] range.
+        if(((next - home) & mask) >= ((next - hole) & mask)) {
+
+            set->slots[hole] = set->slots[next];
+            hole = next;
+        }
+
+        next = (next + 1) & mask;
+    }
+
+    set->slots[hole] = HASH_SET_EMPTY;
+    --set->size;
+
+    return true;
+}
+
+void hash_set_destroy(hash_set_t **set) {
+
+    NNULL(*set, "hash_set_destroy");
+
+    free((*set)->slots);
+    free(*set);
+
+    *set = NULL;
+}
+
+static size_t hash_set_slot(hash_set_t *set, long value) {
+
+    // Fibonacci hashing spreads consecutive ratings over the whole table.
+    unsigned long hash = (unsigned long) value * 11400714819323198485ul;
+
+    return (size_t) (hash >> 32) & (set->capacity - 1);
+}
+
+static void hash_set_grow(hash_set_t *set) {
+
+    long *oldSlots = set->slots;
+    size_t oldCapacity = set->capacity;
+
+    set->capacity = oldCapacity == 0 ? HASH_SET_INITIAL_CAPACITY
+                                     : 2 * oldCapacity;
+    set->slots = malloc(set->capacity * sizeof(long));
+
+    // Assure that malloc has not failed.
+    NNULL(set->slots, "hash_set_grow");
+
+    for(size_t i = 0; i < set->capacity; ++i) {
+        set->slots[i] = HASH_SET_EMPTY;
+    }
+
+    set->size = 0;
+
+    for(size_t i = 0; i < oldCapacity; ++i) {
+
+        if(oldSlots[i] != HASH_SET_EMPTY) {
+            hash_set_insert(set, oldSlots[i]);
+        }
+    }
+
+    free(oldSlots);
+}
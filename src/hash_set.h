@@ -0,0 +1,42 @@
+/**
+ * Hash set of integers with open addressing and linear probing.
+ * Insertion, removal and lookup take expected constant time.
+ * LONG_MIN is reserved as the empty slot marker and cannot be stored.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef HASH_SET_H
+#define HASH_SET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Set of distinct longs. The capacity is always a power of two.
+typedef struct hash_set_t {
+
+    long *slots;
+    size_t size;
+    size_t capacity;
+
+} hash_set_t;
+
+// Makes a new empty set object.
+hash_set_t *hash_set_make();
+
+// Returns true iff the value is in the set.
+bool hash_set_contains(hash_set_t *set, long value);
+
+// Adds the value to the set.
+// Returns false and does nothing if it is already present.
+bool hash_set_insert(hash_set_t *set, long value);
+
+// Removes the value from the set.
+// Returns false and does nothing if it is not present.
+bool hash_set_remove(hash_set_t *set, long value);
+
+// Releases all the memory held by the set and NULLs the pointer.
+void hash_set_destroy(hash_set_t **set);
+
+#endif // HASH_SET_H
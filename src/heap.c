@@ -0,0 +1,176 @@
+/**
+ * Implementation of heap.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include "heap.h"
+#include "defines.h"
+
+// Capacity of the heap after the first push.
+#define HEAP_INITIAL_CAPACITY 16
+
+// Internal auxiliary function moving the element at position up
+// until its parent is not greater.
+static void heap_sift_up(heap_elem_t *data, size_t position);
+
+// Internal auxiliary function moving the element at position down
+// until its children are not smaller. Considers only the first size elements.
+static void heap_sift_down(heap_elem_t *data, size_t size, size_t position);
+
+
+heap_t *heap_make() {
+
+    heap_t *heap = malloc(sizeof(heap_t));
+
+    // Assure that malloc has not failed.
+    NNULL(heap, "heap_make");
+
+    heap->data = NULL;
+    heap->size = 0;
+    heap->capacity = 0;
+
+    return heap;
+}
+
+heap_elem_t heap_make_elem(long key, long value) {
+
+    heap_elem_t elem;
+    elem.key = key;
+    elem.value = value;
+
+    return elem;
+}
+
+heap_elem_t heap_top(heap_t *heap) {
+
+    NNULL(heap, "heap_top");
+
+    return heap->data[0];
+}
+
+void heap_push(heap_t *heap, heap_elem_t elem) {
+
+    NNULL(heap, "heap_push");
+
+    if(heap->size == heap->capacity) {
+
+        heap->capacity = heap->capacity == 0 ? HEAP_INITIAL_CAPACITY
+                                             : 2 * heap->capacity;
+        heap->data = realloc(heap->data,
+                             heap->capacity * sizeof(heap_elem_t));
+
+        // Assure that realloc has not failed.
+        NNULL(heap->data, "heap_push");
+    }
+
+    heap->data[heap->size] = elem;
+    heap_sift_up(heap->data, heap->size);
+
+    ++heap->size;
+}
+
+heap_elem_t heap_pop(heap_t *heap) {
+
+    NNULL(heap, "heap_pop");
+
+    heap_elem_t top = heap->data[0];
+
+    --heap->size;
+
+    if(heap->size > 0) {
+
+        heap->data[0] = heap->data[heap->size];
+        heap_sift_down(heap->data, heap->size, 0);
+    }
+
+    return top;
+}
+
+void heap_replace_top(heap_t *heap, heap_elem_t elem) {
+
+    NNULL(heap, "heap_replace_top");
+
+    heap->data[0] = elem;
+    heap_sift_down(heap->data, heap->size, 0);
+}
+
+void heap_sort(heap_t *heap) {
+
+    NNULL(heap, "heap_sort");
+
+    // Move the minimum to the end of the shrinking heap each time,
+    // so the smallest elements end up at the back.
+    while(heap->size > 1) {
+
+        --heap->size;
+
+        heap_elem_t top = heap->data[0];
+        heap->data[0] = heap->data[heap->size];
+        heap->data[heap->size] = top;
+
+        heap_sift_down(heap->data, heap->size, 0);
+    }
+
+    heap->size = 0;
+}
+
+void heap_clear(heap_t *heap) {
+
+    NNULL(heap, "heap_clear");
+
+    heap->size = 0;
+}
+
+void heap_destroy(heap_t **heap) {
+
+    NNULL(*heap, "heap_destroy");
+
+    free((*heap)->data);
+    free(*heap);
+
+    *heap = NULL;
+}
+
+static void heap_sift_up(heap_elem_t *data, size_t position) {
+
+    heap_elem_t elem = data[position];
+
+    while(position > 0) {
+
+        size_t parent = (position - 1) / 2;
+
+        if(data[parent].key <= elem.key) {
+            break;
+        }
+
+        data[position] = data[parent];
+        position = parent;
+    }
+
+    data[position] = elem;
+}
+
+static void heap_sift_down(heap_elem_t *data, size_t size, size_t position) {
+
+    heap_elem_t elem = data[position];
+
+    while(2 * position + 1 < size) {
+
+        size_t child = 2 * position + 1;
+
+        // Pick the smaller of the two children.
+        if(child + 1 < size && data[child + 1].key < data[child].key) {
+            ++child;
+        }
+
+        if(elem.key <= data[child].key) {
+            break;
+        }
+
+        data[position] = data[child];
+        position = child;
+    }
+
+    data[position] = elem;
+}
@@ -0,0 +1,63 @@
+/**
+ * Binary min-heap data structure.
+ * Pushing and popping take logarithmic time, reading the minimum takes
+ * constant time. The elements are kept in a single growing array.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+
+// Elements held in the heap. Ordered by key, value is moved along with it.
+typedef struct heap_elem_t {
+
+    long key;
+    long value;
+
+} heap_elem_t;
+
+// Heap with the smallest key at data[0].
+typedef struct heap_t {
+
+    heap_elem_t *data;
+    size_t size;
+    size_t capacity;
+
+} heap_t;
+
+// Makes a new empty heap object.
+heap_t *heap_make();
+
+// Makes a new heap_elem_t object with passed key and value.
+heap_elem_t heap_make_elem(long key, long value);
+
+// Returns the element with the smallest key. The heap has to be not empty.
+heap_elem_t heap_top(heap_t *heap);
+
+// Adds the element to the heap.
+void heap_push(heap_t *heap, heap_elem_t elem);
+
+// Removes and returns the element with the smallest key.
+// The heap has to be not empty.
+heap_elem_t heap_pop(heap_t *heap);
+
+// Replaces the element with the smallest key with the passed one.
+// Cheaper than a pop followed by a push. The heap has to be not empty.
+void heap_replace_top(heap_t *heap, heap_elem_t elem);
+
+// Sorts the elements in place by descending keys.
+// The heap is left empty, but data holds the sorted elements
+// until the next push.
+void heap_sort(heap_t *heap);
+
+// Removes all the elements, keeps the memory for reuse.
+void heap_clear(heap_t *heap);
+
+// Releases all the memory held by the heap and NULLs the pointer.
+void heap_destroy(heap_t **heap);
+
+#endif // HEAP_H
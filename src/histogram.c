@@ -0,0 +1,115 @@
+/**
+ * Implementation of histogram.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include <string.h>
+#include "histogram.h"
+#include "defines.h"
+
+// Binary logarithm of HISTOGRAM_SUB_BUCKETS.
+#define HISTOGRAM_SUB_BITS 4
+
+// Internal auxiliary function giving the bucket of the value.
+static size_t histogram_bucket(unsigned long value);
+
+// Internal auxiliary function giving the highest value in the bucket.
+static unsigned long histogram_bucket_max(size_t bucket);
+
+
+histogram_t *histogram_make() {
+
+    histogram_t *histogram = malloc(sizeof(histogram_t));
+
+    // Assure that malloc has not failed.
+    NNULL(histogram, "histogram_make");
+
+    memset(histogram, 0, sizeof(histogram_t));
+
+    return histogram;
+}
+
+void histogram_record(histogram_t *histogram, unsigned long value) {
+
+    NNULL(histogram, "histogram_record");
+
+    ++histogram->buckets[histogram_bucket(value)];
+    ++histogram->count;
+
+    if(value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+unsigned long histogram_percentile(histogram_t *histogram, double percent) {
+
+    NNULL(histogram, "histogram_percentile");
+
+    if(histogram->count == 0) {
+        return 0;
+    }
+
+    // Rank of the value we are looking for, counting from one.
+    unsigned long rank = (unsigned long) (percent / 100 * histogram->count);
+
+    if(rank < histogram->count && rank * 100 < percent * histogram->count) {
+        ++rank;
+    }
+
+    if(rank == 0) {
+        rank = 1;
+    }
+
+    unsigned long seen = 0;
+
+    for(size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+
+        seen += histogram->buckets[i];
+
+        if(seen >= rank) {
+
+            unsigned long bucketMax = histogram_bucket_max(i);
+
+            return bucketMax < histogram->max ? bucketMax : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+void histogram_destroy(histogram_t **histogram) {
+
+    NNULL(*histogram, "histogram_destroy");
+
+    free(*histogram);
+
+    *histogram = NULL;
+}
+
+static size_t histogram_bucket(unsigned long value) {
+
+    // Small values have a bucket each.
+    if(value < HISTOGRAM_SUB_BUCKETS) {
+        return (size_t) value;
+    }
+
+    int exponent = 63 - __builtin_clzl(value);
+    unsigned long sub = (value >> (exponent - HISTOGRAM_SUB_BITS)) &
+                        (HISTOGRAM_SUB_BUCKETS - 1);
+
+    return (size_t) (exponent - HISTOGRAM_SUB_BITS + 1) *
+           HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+static unsigned long histogram_bucket_max(size_t bucket) {
+
+    if(bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    int shift = (int) (bucket / HISTOGRAM_SUB_BUCKETS) - 1;
+    unsigned long sub = bucket % HISTOGRAM_SUB_BUCKETS;
+
+    return ((HISTOGRAM_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
@@ -0,0 +1,42 @@
+/**
+ * Histogram of non-negative values with logarithmic buckets, each power
+ * of two split into HISTOGRAM_SUB_BUCKETS linear ones. Recording takes
+ * constant time and percentiles are reported with a relative error
+ * below 1 / HISTOGRAM_SUB_BUCKETS.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// Number of linear buckets every power of two is split into.
+#define HISTOGRAM_SUB_BUCKETS 16
+
+// Number of buckets covering all unsigned longs.
+#define HISTOGRAM_BUCKETS (61 * HISTOGRAM_SUB_BUCKETS)
+
+// Counts of the recorded values in every bucket.
+typedef struct histogram_t {
+
+    unsigned long count;
+    unsigned long max;
+    unsigned long buckets[HISTOGRAM_BUCKETS];
+
+} histogram_t;
+
+// Makes a new empty histogram object.
+histogram_t *histogram_make();
+
+// Records a single value.
+void histogram_record(histogram_t *histogram, unsigned long value);
+
+// Returns the smallest value not exceeded by the given percent of the
+// recorded values, up to the bucket precision. Zero if there are none.
+unsigned long histogram_percentile(histogram_t *histogram, double percent);
+
+// Releases all the memory held by the histogram and NULLs the pointer.
+void histogram_destroy(histogram_t **histogram);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,237 @@
+/**
+ * Implementation of input.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+#include "defines.h"
+
+// Size of the read buffer, it is doubled for lines that do not fit.
+#define INPUT_BLOCK_SIZE (1 << 20)
+
+// Internal auxiliary function trying to map the whole descriptor.
+// Returns false if it is not a regular file or mapping failed.
+static bool input_map(input_t *input);
+
+// Internal auxiliary function moving the unreturned bytes to the front
+// of the buffer and reading the next block after them.
+// Returns false if nothing more could be read.
+static bool input_fill(input_t *input);
+
+
+input_t *input_open(int fd) {
+
+    input_t *input = malloc(sizeof(input_t));
+
+    // Assure that malloc has not failed.
+    NNULL(input, "input_open");
+
+    input->fd = fd;
+    input->finished = false;
+    input->error = 0;
+    input->position = 0;
+    input->idle = NULL;
+
+    if(input_map(input)) {
+        return input;
+    }
+
+    input->mapped = false;
+    input->size = 0;
+    input->capacity = INPUT_BLOCK_SIZE;
+    input->data = malloc(input->capacity);
+
+    // Assure that malloc has not failed.
+    NNULL(input->data, "input_open");
+
+    return input;
+}
+
+void input_set_idle(input_t *input, input_idle_t idle) {
+
+    NNULL(input, "input_set_idle");
+
+    input->idle = idle;
+}
+
+bool input_read_line(input_t *input, const char **line, size_t *length) {
+
+    NNULL(input, "input_read_line");
+
+    while(true) {
+
+        char *start = input->data + input->position;
+        char *newline = memchr(start, '\n', input->size - input->position);
+
+        if(newline != NULL) {
+
+            *line = start;
+            *length = (size_t) (newline - start);
+
+            input->position += *length + 1;
+
+            return true;
+        }
+
+        if(input->mapped || !input_fill(input)) {
+            return false;
+        }
+    }
+}
+
+bool input_read_record(input_t *input, size_t size, const char **record) {
+
+    NNULL(input, "input_read_record");
+
+    if(!input_peek(input, size, record)) {
+        return false;
+    }
+
+    input->position += size;
+
+    return true;
+}
+
+bool input_peek(input_t *input, size_t size, const char **data) {
+
+    NNULL(input, "input_peek");
+
+    while(input->size - input->position < size) {
+
+        if(input->mapped || !input_fill(input)) {
+            return false;
+        }
+    }
+
+    *data = input->data + input->position;
+
+    return true;
+}
+
+int input_error(const input_t *input) {
+
+    NNULL(input, "input_error");
+
+    return input->error;
+}
+
+void input_close(input_t **input) {
+
+    NNULL(*input, "input_close");
+
+    if((*input)->mapped) {
+        munmap((*input)->data, (*input)->size);
+    }
+    else {
+        free((*input)->data);
+    }
+
+    free(*input);
+
+    *input = NULL;
+}
+
+static bool input_map(input_t *input) {
+
+    struct stat status;
+
+    if(fstat(input->fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+        return false;
+    }
+
+    off_t offset = lseek(input->fd, 0, SEEK_CUR);
+
+    // Empty files cannot be mapped, but they are trivial to read anyway.
+    if(offset < 0 || status.st_size <= offset) {
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE,
+                      input->fd, 0);
+
+    if(data == MAP_FAILED) {
+        return false;
+    }
+
+    // The file is read sequentially, once.
+    posix_madvise(data, (size_t) status.st_size, POSIX_MADV_SEQUENTIAL);
+
+    input->mapped = true;
+    input->data = data;
+    input->size = (size_t) status.st_size;
+    input->capacity = input->size;
+    input->position = (size_t) offset;
+
+    return true;
+}
+
+static bool input_fill(input_t *input) {
+
+    if(input->finished) {
+        return false;
+    }
+
+    size_t remaining = input->size - input->position;
+
+    memmove(input->data, input->data + input->position, remaining);
+
+    input->size = remaining;
+    input->position = 0;
+
+    // The whole buffer is a single unfinished line.
+    if(input->size == input->capacity) {
+
+        input->capacity *= 2;
+        input->data = realloc(input->data, input->capacity);
+
+        // Assure that realloc has not failed.
+        NNULL(input->data, "input_fill");
+    }
+
+    // Only a read that would wait lets the consumer catch up first,
+    // while the data keeps coming it is taken in large blocks.
+    if(input->idle != NULL) {
+
+        struct pollfd ready = {input->fd, POLLIN, 0};
+
+        if(poll(&ready, 1, 0) <= 0) {
+            input->idle();
+        }
+    }
+
+    ssize_t bytesRead;
+
+    do {
+        bytesRead = read(input->fd, input->data + input->size,
+                         input->capacity - input->size);
+    } while(bytesRead < 0 && errno == EINTR);
+
+    // Nothing to read yet from a non-blocking descriptor.
+    if(bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return false;
+    }
+
+    if(bytesRead <= 0) {
+
+        input->finished = true;
+
+        if(bytesRead < 0) {
+            input->error = errno;
+        }
+
+        return false;
+    }
+
+    input->size += (size_t) bytesRead;
+
+    return true;
+}
@@ -0,0 +1,78 @@
+/**
+ * Line or record based input. Regular files are memory-mapped as a whole,
+ * other descriptors (pipes, terminals) are read in large blocks.
+ * Only lines ending with a newline are returned, an unterminated last
+ * line is dropped. Likewise a truncated last record is dropped.
+ * On a non-blocking descriptor the reads return false as soon as nothing
+ * more can be read right away, the input is not finished until the end
+ * of data or an error, so the reads can be repeated when it is readable.
+ * An error finishes the input like the end of data, but it is kept
+ * for the caller to report.
+ * An input can have an idle function, called whenever nothing more can be
+ * read right away, before waiting for it.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Called before the input waits for more data.
+typedef void (*input_idle_t)(void);
+
+// State of a single input source.
+typedef struct input_t {
+
+    int fd;
+    bool mapped;
+    bool finished;
+
+    // Error number of the read that finished the input, 0 if none failed.
+    int error;
+
+    // Mapped file or the read buffer and the number of valid bytes in it.
+    char *data;
+    size_t size;
+    size_t capacity;
+
+    // Start of the first line not yet returned.
+    size_t position;
+
+    // Called before waiting for more data, NULL if there is none.
+    input_idle_t idle;
+
+} input_t;
+
+// Opens the input reading from the descriptor, which is not closed
+// by input_close.
+input_t *input_open(int fd);
+
+// Sets the idle function called before waiting for data, NULL for none.
+void input_set_idle(input_t *input, input_idle_t idle);
+
+// Sets line to the start of the next line and length to its length without
+// the newline. The line stays valid until the next call.
+// Returns false if there are no more lines.
+bool input_read_line(input_t *input, const char **line, size_t *length);
+
+// Sets record to the start of the next size bytes, which stay valid until
+// the next call. Returns false if there are less of them left.
+bool input_read_record(input_t *input, size_t size, const char **record);
+
+// Sets data to the start of the next size bytes without taking them,
+// so the next read starts at the same place. They stay valid until
+// the next call. Returns false if there are less of them left.
+bool input_peek(input_t *input, size_t size, const char **data);
+
+// Returns the error number of the failed read that finished the input,
+// 0 if it has not failed.
+int input_error(const input_t *input);
+
+// Releases the resources of the input and NULLs the pointer.
+void input_close(input_t **input);
+
+#endif // INPUT_H
@@ -4,27 +4,253 @@
  * Author: Mateusz Gienieczko
  * Copyright (C) 2018
  */
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <string.h>
-#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "defines.h"
+#include "command.h"
+#include "input.h"
+#include "output.h"
 #include "marathon_tree.h"
+#include "histogram.h"
+#include "oplog.h"
+#include "server.h"
+
+// Options given in the command line.
+typedef struct options_t {
+
+    // Input file, NULL for the standard input.
+    const char *fileName;
+
+    // Unix domain socket whose clients are served instead of reading
+    // the input, NULL if not given.
+    const char *socketName;
+
+    bool ordered;
+    unsigned int threads;
+
+    // Snapshot loaded and log replayed before reading the input,
+    // and log the operations are appended to, NULL if not given.
+    const char *snapshotName;
+    const char *replayName;
+    const char *logName;
+    size_t groupSize;
+    unsigned int groupTime;
+
+} options_t;
+
+// Buffered standard and diagnostic outputs.
+static output_t *standardOutput = NULL;
+static output_t *diagnosticOutput = NULL;
+
+// True iff commands and responses are binary records instead of lines.
+static bool binaryMode = false;
+
+// Log of the successful operations changing the tree, NULL if not logged.
+static oplog_t *operationLog = NULL;
+
+// True iff the log has failed. No more commands are taken then and
+// the responses not written out yet are dropped.
+static bool logFailed = false;
+
+// Server of the clients of the socket and the client being served,
+// NULL when reading the input.
+static server_t *server = NULL;
+static server_client_t *currentClient = NULL;
+
+// Consecutive marathons waiting to be answered together, in input order.
+// Only used with more than one thread.
+static bool batchMarathons = false;
+static marathon_query_t marathonBatch[MARATHON_BATCH_SIZE];
+static size_t marathonBatchSize = 0;
+
+// Open marathon cursors indexed by their identifiers, NULL for the closed
+// ones, whose identifiers wait on the stack to be reused. Each is only
+// usable by the client that opened it.
+static marathon_cursor_t **cursors = NULL;
+static server_client_t **cursorOwners = NULL;
+static size_t cursorCount = 0;
+static size_t cursorCapacity = 0;
+static unsigned int *freeCursors = NULL;
+static size_t freeCursorCount = 0;
+
+#ifdef MARATHON_STATS
+
+// Names of the measured commands, indexed by their type.
+static const char *commandNames[COMMAND_STATS] = {
+    [COMMAND_ADD_USER] = CTRL_STR_ADDUSER,
+    [COMMAND_DEL_USER] = CTRL_STR_DELUSER,
+    [COMMAND_ADD_MOVIE] = CTRL_STR_ADDMOVIE,
+    [COMMAND_DEL_MOVIE] = CTRL_STR_DELMOVIE,
+    [COMMAND_MARATHON] = CTRL_STR_MARATHON,
+    [COMMAND_ADD_MOVIES] = CTRL_STR_ADDMOVIES,
+    [COMMAND_DEL_MOVIES] = CTRL_STR_DELMOVIES,
+    [COMMAND_MARATHON_OPEN] = CTRL_STR_MARATHONOPEN,
+    [COMMAND_MARATHON_NEXT] = CTRL_STR_MARATHONNEXT,
+    [COMMAND_MARATHON_CLOSE] = CTRL_STR_MARATHONCLOSE,
+    [COMMAND_SAVE] = CTRL_STR_SAVE,
+    [COMMAND_LOAD] = CTRL_STR_LOAD
+};
+
+// Latencies of the measured commands in nanoseconds, indexed by their type.
+static histogram_t *latencies[COMMAND_STATS];
+
+// Current time in nanoseconds.
+unsigned long stats_now() {
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (unsigned long) now.tv_sec * 1000000000UL +
+           (unsigned long) now.tv_nsec;
+}
+
+// Print count, p50, p99 and max latency of every command that was measured.
+void print_stats(output_t *output) {
+
+    for(int type = 0; type < COMMAND_STATS; ++type) {
+
+        if(commandNames[type] == NULL) {
+            continue;
+        }
 
-// Create the tree and the input buffer.
-void initialize(char **buffer, size_t *bufferSize) {
+        histogram_t *histogram = latencies[type];
+
+        output_write_string(output, commandNames[type]);
+        output_write_string(output, " count: ");
+        output_write_long(output, (long) histogram->count);
+        output_write_string(output, ", p50: ");
+        output_write_long(output, (long) histogram_percentile(histogram, 50));
+        output_write_string(output, " ns, p99: ");
+        output_write_long(output, (long) histogram_percentile(histogram, 99));
+        output_write_string(output, " ns, max: ");
+        output_write_long(output, (long) histogram->max);
+        output_write_string(output, " ns\n");
+    }
+}
+
+#endif // MARATHON_STATS
+
+// Write out everything buffered, also when exiting on a fatal error.
+// With a log the responses are dropped instead, the operations they
+// acknowledge may not be on the disk, and the log may be what failed.
+void flush_outputs() {
+
+    if(standardOutput != NULL && operationLog == NULL) {
+        output_flush(standardOutput);
+    }
 
-    *bufferSize = INITIAL_BUFFER_SIZE;
-    *buffer = malloc(*bufferSize * sizeof(char));
+    if(diagnosticOutput != NULL) {
+        output_flush(diagnosticOutput);
+    }
+}
+
+// Commit the logged operations before their responses are written out,
+// so that no operation is acknowledged before it is on the disk.
+// Once the log is closed everything in it has been committed.
+// Returns false if the log has failed, the failure is reported once
+// and the commands stop being taken.
+bool commit_log() {
+
+    if(operationLog == NULL || logFailed) {
+        return !logFailed;
+    }
+
+    if(!oplog_commit(operationLog)) {
+
+        logFailed = true;
+
+        serr("Could not write the operation log: %s\n",
+             strerror(oplog_error(operationLog)));
+
+        if(server != NULL) {
+            server_stop(server);
+        }
+    }
 
-    marathon_tree_initialize();
+    return !logFailed;
 }
 
 // Release resources.
-void cleanup(char **buffer, size_t *bufferSize) {
+void cleanup(input_t **input) {
+
+    if(*input != NULL) {
+
+        int fd = (*input)->fd;
+
+        input_close(input);
+
+        if(fd != STDIN_FILENO) {
+            close(fd);
+        }
+    }
+
+    if(server != NULL) {
+        server_close(&server);
+    }
+
+#ifdef MARATHON_STATS
+
+    unsigned long hits, misses;
+
+    marathon_tree_get_cache_stats(&hits, &misses);
+
+    output_write_string(diagnosticOutput, "Marathon cache hits: ");
+    output_write_long(diagnosticOutput, (long) hits);
+    output_write_string(diagnosticOutput, ", misses: ");
+    output_write_long(diagnosticOutput, (long) misses);
+    output_write_char(diagnosticOutput, '\n');
+
+    unsigned long inlineSets, treeSets;
+
+    marathon_tree_get_set_stats(&inlineSets, &treeSets);
+
+    output_write_string(diagnosticOutput, "Movie sets inline: ");
+    output_write_long(diagnosticOutput, (long) inlineSets);
+    output_write_string(diagnosticOutput, ", promoted: ");
+    output_write_long(diagnosticOutput, (long) treeSets);
+    output_write_char(diagnosticOutput, '\n');
+
+    print_stats(diagnosticOutput);
+
+    for(int type = 0; type < COMMAND_STATS; ++type) {
+
+        if(latencies[type] != NULL) {
+            histogram_destroy(&latencies[type]);
+        }
+    }
+
+#endif // MARATHON_STATS
+
+    if(operationLog != NULL) {
+
+        // A failure of the last group drops the last responses as well.
+        commit_log();
 
-    free(*buffer);
-    *bufferSize = 0;
+        oplog_close(&operationLog);
+    }
+
+    for(size_t i = 0; i < cursorCount; ++i) {
+
+        if(cursors[i] != NULL) {
+            marathon_tree_close_cursor(&cursors[i]);
+        }
+    }
+
+    free(cursors);
+    free(cursorOwners);
+    free(freeCursors);
+
+    output_close(&standardOutput);
+    output_close(&diagnosticOutput);
 
     marathon_tree_cleanup();
 }
@@ -87,159 +313,923 @@ bool process_del_movie(long userID, long movieRating) {
     return marathon_tree_remove_movie((unsigned int) userID, movieRating);
 }
 
-// Try to perform the marathon operation.
+// Write a single binary response value to the standard output.
+void print_binary(uint32_t value) {
+
+    output_write(standardOutput, (const char *) &value, sizeof(value));
+}
+
+// Print the ERROR_MSG from defines.h, or its binary counterpart.
+void print_error() {
+
+    if(binaryMode) {
+        print_binary(BINARY_ERROR_MSG);
+    }
+    else {
+        output_write_string(diagnosticOutput, ERROR_MSG);
+    }
+}
+
+// Print the OK_MSG from defines.h, or its binary counterpart.
+void print_ok() {
+
+    if(binaryMode) {
+        print_binary(BINARY_OK_MSG);
+    }
+    else {
+        output_write_string(standardOutput, OK_MSG);
+    }
+}
+
+// Print the movies with single spaces between them, or EMPTY_LIST_MSG
+// from defines.h if there are none. In binary mode print their number
+// and the movies themselves.
+void print_movie_list(sarray_t *movies) {
+
+    if(binaryMode) {
+
+        print_binary((uint32_t) movies->size);
+
+        // Ratings are non-negative ints, the same as their binary form.
+        output_write(standardOutput, (const char *) movies->data,
+                     movies->size * sizeof(int));
+
+        return;
+    }
+
+    if(movies->size == 0) {
+
+        output_write_string(standardOutput, EMPTY_LIST_MSG);
+
+        return;
+    }
+
+    for(size_t i = 0; i < movies->size; ++i) {
+
+        if(i > 0) {
+            output_write_char(standardOutput, ' ');
+        }
+
+        output_write_long(standardOutput, movies->data[i]);
+    }
+
+    output_write_char(standardOutput, '\n');
+}
+
+// Print whether each rating of a batch was applied: a line with 1 or 0
+// for every rating, or in binary mode OK followed by the bitmap of them.
+void print_batch_results(const bool *results, size_t count) {
+
+    if(binaryMode) {
+
+        print_binary(BINARY_OK_MSG);
+
+        for(size_t word = 0; word < (count + 31) / 32; ++word) {
+
+            uint32_t bits = 0;
+
+            for(size_t i = 32 * word; i < count && i < 32 * (word + 1); ++i) {
+
+                if(results[i]) {
+                    bits |= (uint32_t) 1 << (i % 32);
+                }
+            }
+
+            print_binary(bits);
+        }
+
+        return;
+    }
+
+    for(size_t i = 0; i < count; ++i) {
+        output_write_char(standardOutput, results[i] ? '1' : '0');
+    }
+
+    output_write_char(standardOutput, '\n');
+}
+
+// Try to perform the save or load operation on the path
+// given as the only argument.
+bool process_snapshot(command_t command) {
+
+    if(command.argCount != 1) {
+        return false;
+    }
+
+    char *path = strndup(command.path, command.pathLength);
+
+    // Assure that strndup has not failed.
+    NNULL(path, "process_snapshot");
+
+    bool result = command.type == COMMAND_SAVE ? marathon_tree_save(path)
+                                               : marathon_tree_load(path);
+
+    free(path);
+
+    // The saved snapshot holds everything that was logged so far and is
+    // already on the disk in place of the previous one, so the log can go.
+    // A loaded one is not the recovery base, the log keeps what it has.
+    if(result && command.type == COMMAND_SAVE && operationLog != NULL) {
+        result = oplog_truncate(operationLog);
+    }
+
+    return result;
+}
+
+// Append the successful operation changing the tree to the log.
+void log_command(command_t command) {
+
+    char record[COMMAND_RECORD_SIZE];
+
+    if(command_encode(command, record)) {
+        oplog_append(operationLog, record);
+    }
+}
+
+// Try to perform the addMovies or delMovies operation and print whether
+// each of its ratings was applied, as a line of ones and zeros or
+// a bitmap in binary mode. Every applied rating is logged on its own.
+bool process_movie_batch(command_t command) {
+
+    if(command.list == NULL || command.listCount == 0 ||
+       command.listCount > MAX_MOVIE_BATCH || !is_in_user_range(command.arg1)) {
+
+        return false;
+    }
+
+    size_t count = command.listCount;
+    long *ratings = malloc(count * sizeof(long));
+    int *movies = malloc(count * sizeof(int));
+    size_t *positions = malloc(count * sizeof(size_t));
+    bool *applied = malloc(count * sizeof(bool));
+    bool *results = malloc(count * sizeof(bool));
+
+    // Assure that malloc has not failed.
+    NNULL(ratings, "ratings/process_movie_batch");
+    NNULL(movies, "movies/process_movie_batch");
+    NNULL(positions, "positions/process_movie_batch");
+    NNULL(applied, "applied/process_movie_batch");
+    NNULL(results, "results/process_movie_batch");
+
+    command_get_list(command, ratings);
+
+    // Ratings out of range fail on their own, the rest go to the tree.
+    size_t movieCount = 0;
+
+    for(size_t i = 0; i < count; ++i) {
+
+        results[i] = false;
+
+        if(is_in_movie_range(ratings[i])) {
+
+            movies[movieCount] = (int) ratings[i];
+            positions[movieCount] = i;
+            ++movieCount;
+        }
+    }
+
+    unsigned int userID = (unsigned int) command.arg1;
+    bool correct = command.type == COMMAND_ADD_MOVIES ?
+                   marathon_tree_add_movies(userID, movies, movieCount,
+                                            applied) :
+                   marathon_tree_remove_movies(userID, movies, movieCount,
+                                               applied);
+
+    for(size_t i = 0; correct && i < movieCount; ++i) {
+        results[positions[i]] = applied[i];
+    }
+
+    if(correct && operationLog != NULL) {
+
+        command_t single = command;
+        single.type = command.type == COMMAND_ADD_MOVIES ? COMMAND_ADD_MOVIE
+                                                         : COMMAND_DEL_MOVIE;
+
+        for(size_t i = 0; i < count; ++i) {
+
+            if(results[i]) {
+
+                single.arg2 = ratings[i];
+                log_command(single);
+            }
+        }
+    }
+
+    if(correct) {
+        print_batch_results(results, count);
+    }
+
+    free(ratings);
+    free(movies);
+    free(positions);
+    free(applied);
+    free(results);
+
+    return correct;
+}
+
+// Answer the waiting marathons and print their results in order.
+void flush_marathons() {
+
+    if(marathonBatchSize == 0) {
+        return;
+    }
+
+#ifdef MARATHON_STATS
+    unsigned long start = stats_now();
+#endif
+
+    marathon_tree_run_queries(marathonBatch, marathonBatchSize);
+
+#ifdef MARATHON_STATS
+
+    // The queries are answered together, each gets an equal share.
+    unsigned long share = (stats_now() - start) / marathonBatchSize;
+
+    for(size_t i = 0; i < marathonBatchSize; ++i) {
+        histogram_record(latencies[COMMAND_MARATHON], share);
+    }
+
+#endif // MARATHON_STATS
+
+    for(size_t i = 0; i < marathonBatchSize; ++i) {
+
+        if(marathonBatch[i].result != NULL) {
+
+            print_movie_list(marathonBatch[i].result);
+            sarray_destroy(&marathonBatch[i].result);
+        }
+        else {
+            print_error();
+        }
+    }
+
+    marathonBatchSize = 0;
+}
+
+// Answer everything read so far before waiting for more commands,
+// so that a client sending them one at a time gets every response.
+void flush_responses() {
+
+    flush_marathons();
+
+    output_flush(standardOutput);
+    output_flush(diagnosticOutput);
+}
+
+// Try to perform the marathon operation. With more than one thread
+// the marathon waits in the batch and its result is printed later.
 bool process_marathon(long userID, long k) {
 
     if(!is_in_user_range(userID) || !is_in_marathon_range(k)) {
+
+        // The error has to follow the results of the earlier marathons.
+        flush_marathons();
+
         return false;
     }
 
-    dlist_t *marathonResult = marathon_tree_get_marathon_list(
+    if(batchMarathons) {
+
+        marathonBatch[marathonBatchSize].userID = (unsigned int) userID;
+        marathonBatch[marathonBatchSize].k = k;
+        ++marathonBatchSize;
+
+        if(marathonBatchSize == MARATHON_BATCH_SIZE) {
+            flush_marathons();
+        }
+
+        return true;
+    }
+
+    sarray_t *marathonResult = marathon_tree_get_marathon_list(
             (unsigned int) userID, k);
 
     if(marathonResult != NULL) {
-        dlist_print_num(marathonResult);
+        print_movie_list(marathonResult);
     }
     else {
         return false;
     }
 
-    dlist_destroy(&marathonResult);
+    sarray_destroy(&marathonResult);
 
     return true;
 }
 
-// Reads a line from the standard input into buffer.
-bool read_line(char **buffer, size_t *bufferSize) {
+// Try to open a cursor over the user's marathon and print its identifier.
+bool process_marathon_open(long userID) {
 
-    int character;
-    unsigned int pos = 0;
+    if(!is_in_user_range(userID) ||
+       (freeCursorCount == 0 && cursorCount == MAX_CURSORS)) {
 
-    while((character = fgetc(stdin)) != '\n' && character != EOF) {
+        return false;
+    }
 
-        if(pos + 1 >= *bufferSize) {
+    marathon_cursor_t *cursor = marathon_tree_open_cursor(
+            (unsigned int) userID);
 
-            *bufferSize *= 2;
-            *buffer = realloc(*buffer, *bufferSize);
+    if(cursor == NULL) {
+        return false;
+    }
+
+    unsigned int cursorID;
+
+    if(freeCursorCount > 0) {
+        cursorID = freeCursors[--freeCursorCount];
+    }
+    else {
+
+        if(cursorCount == cursorCapacity) {
 
-            NNULL(*buffer, "read_line");
+            cursorCapacity = cursorCapacity == 0 ? 16 : 2 * cursorCapacity;
+            cursors = realloc(cursors,
+                              cursorCapacity * sizeof(marathon_cursor_t *));
+            cursorOwners = realloc(cursorOwners,
+                                   cursorCapacity * sizeof(server_client_t *));
+            freeCursors = realloc(freeCursors,
+                                  cursorCapacity * sizeof(unsigned int));
+
+            // Assure that realloc has not failed.
+            NNULL(cursors, "cursors/process_marathon_open");
+            NNULL(cursorOwners, "cursorOwners/process_marathon_open");
+            NNULL(freeCursors, "freeCursors/process_marathon_open");
         }
 
-        (*buffer)[pos++] = (char) character;
+        cursorID = (unsigned int) cursorCount++;
+    }
+
+    cursors[cursorID] = cursor;
+    cursorOwners[cursorID] = currentClient;
+
+    if(binaryMode) {
+        print_binary(cursorID);
+    }
+    else {
+
+        output_write_long(standardOutput, cursorID);
+        output_write_char(standardOutput, '\n');
+    }
+
+    return true;
+}
+
+// True iff the identifier is one of an open cursor of the current client.
+bool is_open_cursor(long cursorID) {
+
+    return cursorID >= 0 && (size_t) cursorID < cursorCount &&
+           cursors[cursorID] != NULL && cursorOwners[cursorID] == currentClient;
+}
+
+// Try to print the next at most n movies of the cursor's marathon.
+bool process_marathon_next(long cursorID, long n) {
+
+    if(!is_open_cursor(cursorID) || !is_in_marathon_range(n)) {
+        return false;
+    }
+
+    sarray_t *movies = marathon_tree_cursor_next(cursors[cursorID], n);
+
+    // The tree has been loaded since the cursor was opened.
+    if(movies == NULL) {
+        return false;
     }
 
-    // The '\n' or eof is removed and replaced with a null termination.
-    (*buffer)[pos] = '\0';
+    print_movie_list(movies);
+    sarray_destroy(&movies);
 
-    return character != EOF;
+    return true;
 }
 
-// Processes the command in buffer by performing the appropriate the operation
+// Try to close the cursor and release its identifier.
+bool process_marathon_close(long cursorID) {
+
+    if(!is_open_cursor(cursorID)) {
+        return false;
+    }
+
+    marathon_tree_close_cursor(&cursors[cursorID]);
+    freeCursors[freeCursorCount++] = (unsigned int) cursorID;
+
+    return true;
+}
+
+// Processes the command by performing the appropriate operation
 // or printing the ERROR_MSG from defines.h.
-void process_line(char *buffer) {
+void process_command(command_t command) {
 
-    // Plus one because of the endline.
-    size_t characters = strlen(buffer) + 1;
+    bool errorFlag = true;
 
-    // Empty line
-    if(characters == 1) {
-        return;
+    // Commands giving results print them instead of OK.
+    bool printOk = true;
+
+    // Only marathons can be answered together, anything else
+    // has to see the tree they were asked about.
+    if(command.type != COMMAND_IGNORED && command.type != COMMAND_MARATHON) {
+        flush_marathons();
     }
 
-    // Comment
-    if(buffer[0] == '#') {
-        return;
+#ifdef MARATHON_STATS
+    unsigned long start = stats_now();
+#endif
+
+    switch(command.type) {
+
+        case COMMAND_IGNORED:
+            return;
+
+        case COMMAND_ADD_USER:
+            errorFlag = !process_add_user(command.arg1, command.arg2);
+            break;
+
+        case COMMAND_DEL_USER:
+            errorFlag = command.argCount > 1 ||
+                        !process_del_user(command.arg1);
+            break;
+
+        case COMMAND_ADD_MOVIE:
+            errorFlag = !process_add_movie(command.arg1, command.arg2);
+            break;
+
+        case COMMAND_DEL_MOVIE:
+            errorFlag = !process_del_movie(command.arg1, command.arg2);
+            break;
+
+        case COMMAND_MARATHON:
+            errorFlag = !process_marathon(command.arg1, command.arg2);
+            printOk = false;
+
+            // Batched marathons are measured when they are answered.
+            if(batchMarathons && !errorFlag) {
+                return;
+            }
+
+            break;
+
+        case COMMAND_ADD_MOVIES:
+        case COMMAND_DEL_MOVIES:
+            errorFlag = !process_movie_batch(command);
+            printOk = false;
+            break;
+
+        case COMMAND_MARATHON_OPEN:
+            errorFlag = command.argCount > 1 ||
+                        !process_marathon_open(command.arg1);
+            printOk = false;
+            break;
+
+        case COMMAND_MARATHON_NEXT:
+            errorFlag = !process_marathon_next(command.arg1, command.arg2);
+            printOk = false;
+            break;
+
+        case COMMAND_MARATHON_CLOSE:
+            errorFlag = command.argCount > 1 ||
+                        !process_marathon_close(command.arg1);
+            break;
+
+        case COMMAND_SAVE:
+        case COMMAND_LOAD:
+            errorFlag = !process_snapshot(command);
+            break;
+
+        case COMMAND_STATS:
+            // Without statistics compiled in it is an unknown command.
+#ifdef MARATHON_STATS
+            errorFlag = command.argCount > 0;
+
+            if(!errorFlag) {
+
+                print_stats(standardOutput);
+
+                return;
+            }
+#endif
+
+            break;
+
+        case COMMAND_INVALID:
+            break;
     }
 
-    // Read the command, up to two arguments and if there is anything else.
-    char *command = strtok(buffer, " \n");
-    char *arg1str = strtok(NULL, " \n");
-    char *arg2str = strtok(NULL, " \n");
-    char *remaining = strtok(NULL, " \n");
+    if(operationLog != NULL && !errorFlag &&
+       command.type >= COMMAND_ADD_USER && command.type <= COMMAND_DEL_MOVIE) {
 
-    // Get the expected length of the input including whitespaces.
-    size_t readLength = (command == NULL ? 0 : strlen(command) + 1) +
-                        (arg1str == NULL ? 0 : strlen(arg1str) + 1) +
-                        (arg2str == NULL ? 0 : strlen(arg2str) + 1);
+        log_command(command);
+    }
 
-    // If remaining is not null, we have junk at the end of the line.
-    // If readLength != characters, there were multiple whitespaces
-    if(remaining != NULL || readLength != characters) {
+#ifdef MARATHON_STATS
 
-        serr(ERROR_MSG);
+    if(command.type != COMMAND_INVALID && command.type != COMMAND_STATS) {
+        histogram_record(latencies[command.type], stats_now() - start);
+    }
 
-        return;
+#endif // MARATHON_STATS
+
+    if(errorFlag) {
+        print_error();
+    }
+    else if(printOk) {
+        print_ok();
     }
+}
 
-    long arg1 = -1, arg2 = -1;
+// Read the payload of the binary batch following its record. A payload
+// too big for a batch is skipped, leaving the list NULL.
+// Returns false if the input ends before the whole payload.
+bool read_payload(input_t *input, command_t *command) {
 
-    if(arg1str != NULL && *arg1str >= '0' && *arg1str <= '9') {
-        arg1 = strtol(arg1str, NULL, 10);
+    if(command->listCount <= MAX_MOVIE_BATCH) {
+        return input_read_record(input, command->listLength, &command->list);
     }
 
-    if(arg2str != NULL && *arg2str >= '0' && *arg2str <= '9') {
-        arg2 = strtol(arg2str, NULL, 10);
+    const char *skipped;
+
+    for(size_t remaining = command->listLength; remaining > 0; ) {
+
+        size_t size = remaining;
+
+        if(size > MAX_MOVIE_BATCH * COMMAND_LIST_ARG_SIZE) {
+            size = MAX_MOVIE_BATCH * COMMAND_LIST_ARG_SIZE;
+        }
+
+        if(!input_read_record(input, size, &skipped)) {
+            return false;
+        }
+
+        remaining -= size;
     }
 
-    // This means that strtol conversion resulted in an overflow
-    // and the argument/s was/were out of range of long.
-    if(errno != 0) {
+    return true;
+}
 
-        serr(ERROR_MSG);
-        errno = 0;
+// Read the next command from the input, a line or in binary mode a record
+// with its payload. A record is only taken once its whole payload can be,
+// as a client may still be sending it. In server mode a payload too big
+// for a batch is not read at all, leaving the list NULL.
+// Returns false if there is no complete command.
+bool read_command(input_t *input, command_t *command) {
 
-        return;
+    if(!binaryMode) {
+
+        const char *line;
+        size_t length;
+
+        if(!input_read_line(input, &line, &length)) {
+            return false;
+        }
+
+        *command = command_parse(line, length);
+
+        return true;
     }
 
-    bool errorFlag = true;
+    const char *record;
+
+    if(!input_peek(input, COMMAND_RECORD_SIZE, &record)) {
+        return false;
+    }
 
-    if(strcmp(command, CTRL_STR_ADDUSER) == 0) {
+    *command = command_decode(record);
 
-        errorFlag = !process_add_user(arg1, arg2);
+    bool skipped = command->listBinary &&
+                   command->listCount > MAX_MOVIE_BATCH;
+
+    if(command->listBinary && !skipped &&
+       !input_peek(input, COMMAND_RECORD_SIZE + command->listLength,
+                   &record)) {
+
+        return false;
     }
-    else if(strcmp(command, CTRL_STR_DELUSER) == 0) {
 
-        errorFlag = arg2str != NULL || !process_del_user(arg1);
+    input_read_record(input, COMMAND_RECORD_SIZE, &record);
+    *command = command_decode(record);
+
+    if(!command->listBinary || (skipped && server != NULL)) {
+        return true;
     }
-    else if(strcmp(command, CTRL_STR_ADDMOVIE) == 0) {
 
-        errorFlag = !process_add_movie(arg1, arg2);
+    // A truncated payload is dropped like a truncated record.
+    return read_payload(input, command);
+}
+
+// Serve a turn of at most SERVER_TURN_SIZE commands of the client. All their
+// responses, errors included, go to the client's output in order.
+// A client sending a batch too big to be read is answered with an error
+// and closed. Returns true if the client may have more commands waiting.
+bool serve_client(server_client_t *client) {
+
+    output_t *standard = standardOutput;
+    output_t *diagnostic = diagnosticOutput;
+    command_t command;
+    size_t served = 0;
+
+    standardOutput = client->output;
+    diagnosticOutput = client->output;
+    currentClient = client;
+
+    if(operationLog != NULL) {
+        output_set_barrier(client->output, commit_log);
     }
-    else if(strcmp(command, CTRL_STR_DELMOVIE) == 0) {
 
-        errorFlag = !process_del_movie(arg1, arg2);
+    while(served < SERVER_TURN_SIZE && !client->closing && !logFailed &&
+          read_command(client->input, &command)) {
+
+        process_command(command);
+        ++served;
+
+        if(command.listBinary && command.list == NULL) {
+            client->closing = true;
+        }
     }
-    else if(strcmp(command, CTRL_STR_MARATHON) == 0) {
 
-        errorFlag = !process_marathon(arg1, arg2);
+    // Marathons are not batched across the turns of different clients.
+    flush_marathons();
 
-        // Marathon does not print OK.
-        if(!errorFlag) {
-            return;
+    standardOutput = standard;
+    diagnosticOutput = diagnostic;
+    currentClient = NULL;
+
+    return served == SERVER_TURN_SIZE;
+}
+
+// Close the cursors left open by the client that is going away.
+void close_client(server_client_t *client) {
+
+    for(size_t i = 0; i < cursorCount; ++i) {
+
+        if(cursors[i] != NULL && cursorOwners[i] == client) {
+
+            marathon_tree_close_cursor(&cursors[i]);
+            freeCursors[freeCursorCount++] = (unsigned int) i;
         }
     }
+}
 
-    if(errorFlag) {
-        serr(ERROR_MSG);
+// Apply the operations from the log with the given path, without
+// any output. Records are decoded straight into the operations.
+void replay_log(const char *path) {
+
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0) {
+
+        perror(path);
+        exit(1);
     }
-    else {
-        printf(OK_MSG);
+
+    input_t *log = input_open(fd);
+    const char *record;
+
+    while(input_read_record(log, COMMAND_RECORD_SIZE, &record)) {
+
+        command_t command = command_decode(record);
+
+        switch(command.type) {
+
+            case COMMAND_ADD_USER:
+                process_add_user(command.arg1, command.arg2);
+                break;
+
+            case COMMAND_DEL_USER:
+                process_del_user(command.arg1);
+                break;
+
+            case COMMAND_ADD_MOVIE:
+                process_add_movie(command.arg1, command.arg2);
+                break;
+
+            case COMMAND_DEL_MOVIE:
+                process_del_movie(command.arg1, command.arg2);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    // The operations after a failed read are missing, so is the tree.
+    if(input_error(log) != 0) {
+
+        serr("%s: %s\n", path, strerror(input_error(log)));
+        exit(1);
     }
+
+    input_close(&log);
+    close(fd);
 }
 
-int main(void) {
+// Create the tree, the outputs and open the input as given in the options.
+// The tree is restored from the snapshot and the log to replay, if they
+// are given, before the operations start being logged.
+void initialize(input_t **input, const options_t *options) {
+
+    int fd = STDIN_FILENO;
 
-    size_t bufferSize;
-    char *buffer;
+    *input = NULL;
+
+    // Opened before any threads are started, so that none of them
+    // takes the termination signals meant for the server.
+    if(options->socketName != NULL) {
+
+        server = server_open(options->socketName, serve_client, close_client);
+
+        if(server == NULL) {
+
+            perror(options->socketName);
+            exit(1);
+        }
+    }
+    else if(options->fileName != NULL) {
+
+        fd = open(options->fileName, O_RDONLY);
+
+        if(fd < 0) {
+
+            perror(options->fileName);
+            exit(1);
+        }
+    }
 
-    initialize(&buffer, &bufferSize);
+    if(server == NULL) {
 
-    while(read_line(&buffer, &bufferSize)) {
+        *input = input_open(fd);
 
-        process_line(buffer);
+        input_set_idle(*input, flush_responses);
     }
 
-    cleanup(&buffer, &bufferSize);
+    standardOutput = output_open(STDOUT_FILENO);
+    diagnosticOutput = output_open(STDERR_FILENO);
+
+    if(options->ordered) {
+        output_pair(standardOutput, diagnosticOutput);
+    }
+
+    atexit(flush_outputs);
+
+    marathon_tree_initialize(options->threads);
+
+    batchMarathons = options->threads > 1;
+
+    if(options->snapshotName != NULL &&
+       !marathon_tree_load(options->snapshotName)) {
+
+        serr("%s: not a correct snapshot\n", options->snapshotName);
+        exit(1);
+    }
+
+    if(options->replayName != NULL) {
+        replay_log(options->replayName);
+    }
+
+    if(options->logName != NULL) {
+
+        operationLog = oplog_open(options->logName, COMMAND_RECORD_SIZE,
+                                  options->groupSize, options->groupTime);
+
+        if(operationLog == NULL) {
+
+            perror(options->logName);
+            exit(1);
+        }
+
+        output_set_barrier(standardOutput, commit_log);
+    }
+
+#ifdef MARATHON_STATS
+
+    for(int type = 0; type < COMMAND_STATS; ++type) {
+
+        if(commandNames[type] != NULL) {
+            latencies[type] = histogram_make();
+        }
+    }
+
+#endif // MARATHON_STATS
+}
+
+// Reads commands from the file given as the only argument,
+// or from the standard input if there is none.
+// Options:
+// -u socket serve the clients connecting to the Unix domain socket
+//    instead, each getting the responses to its own commands, until
+//    SIGINT or SIGTERM,
+// -o keep the relative order of the standard and diagnostic output lines,
+// -b read binary records and print binary responses,
+// -s snapshot load the snapshot before reading the commands,
+// -r log apply the operations from the log before reading the commands,
+// -l log append the operations changing the tree to the log, committed
+//    to the disk every -g operations or -w milliseconds, and always before
+//    the responses acknowledging them are written out. A save empties
+//    the log, since the snapshot holds everything in it. A load is not
+//    logged: until the next save, -s and -r recover the tree without
+//    the load, with all the logged operations applied,
+// -t threads evaluate marathons with the given number of threads,
+//    answering runs of consecutive marathons concurrently.
+int main(int argc, char **argv) {
+
+    input_t *input;
+    command_t command;
+    int readError = 0;
+    options_t options = {NULL, NULL, false, 1, NULL, NULL, NULL,
+                         LOG_GROUP_SIZE, LOG_GROUP_TIME};
+    bool correct = true;
+    long value;
+    char *end;
+    int option;
+
+    while((option = getopt(argc, argv, "obu:t:s:r:l:g:w:")) != -1) {
+
+        switch(option) {
+
+            case 'u':
+                options.socketName = optarg;
+                break;
+
+            case 'o':
+                options.ordered = true;
+                break;
+
+            case 'b':
+                binaryMode = true;
+                break;
+
+            case 't':
+                value = strtol(optarg, &end, 10);
+                correct = correct && *end == '\0' && value >= 1 &&
+                          value <= MAX_THREADS;
+                options.threads = (unsigned int) value;
+                break;
+
+            case 's':
+                options.snapshotName = optarg;
+                break;
+
+            case 'r':
+                options.replayName = optarg;
+                break;
+
+            case 'l':
+                options.logName = optarg;
+                break;
+
+            case 'g':
+                value = strtol(optarg, &end, 10);
+                correct = correct && *end == '\0' && value >= 1;
+                options.groupSize = (size_t) value;
+                break;
+
+            case 'w':
+                value = strtol(optarg, &end, 10);
+                correct = correct && *end == '\0' && value >= 0 &&
+                          value <= INT_MAX;
+                options.groupTime = (unsigned int) value;
+                break;
+
+            default:
+                correct = false;
+                break;
+        }
+    }
+
+    options.fileName = optind < argc ? argv[optind] : NULL;
+
+    // The server has no input of its own.
+    correct = correct &&
+              (options.socketName == NULL || options.fileName == NULL);
+
+    if(!correct) {
+
+        serr("Usage: %s [-o] [-b] [-t threads] [-s snapshot] [-r log] "
+             "[-l log [-g operations] [-w milliseconds]] "
+             "[-u socket | file]\n", argv[0]);
+
+        return 1;
+    }
+
+    initialize(&input, &options);
+
+    if(server != NULL) {
+        server_run(server);
+    }
+    else {
+
+        while(!logFailed && read_command(input, &command)) {
+            process_command(command);
+        }
+
+        // A failed read ends the commands like the end of the input.
+        readError = input_error(input);
+    }
+
+    flush_marathons();
+
+    cleanup(&input);
+
+    // Reported after the responses to the commands read before it.
+    if(readError != 0) {
+        serr("Could not read the input: %s\n", strerror(readError));
+    }
 
-    return 0;
+    return logFailed || readError != 0 ? 1 : 0;
 }
@@ -4,312 +4,2764 @@
  * Author: Mateusz Gienieczko
  * Copyright (C) 2018
  */
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "marathon_tree.h"
+#include "arena.h"
+#include "dlist.h"
+#include "heap.h"
+#include "hash_set.h"
+#include "hash_map.h"
+#include "movie_set.h"
+#include "thread_pool.h"
 #include "defines.h"
 
-// Array holding pointers to children list nodes in which the user is
-// located. For root (userID = 0) it's NULL.
-static dnode_t **users = NULL;
+// Number of positions of the layout scanned by a single task. Ranges
+// of smaller subtrees never leave the calling thread.
+#define MARATHON_TASK_SIZE 4096
 
-// Pointer to the root (userID = 0) of the tree.
-static tree_t *root = NULL;
+// Identifier and slot of the root user, which is never removed.
+#define MARATHON_ROOT 0
 
-// Internal auxiliary function calculating the marathon list recursively.
-static void
-marathon_tree_calculate_marathon_list(tree_t *user, long *remainingSpace,
-                                      dlist_t **resultMovieList,
-                                      long supremum);
+// Marks a missing link in the topology or a missing user.
+#define MARATHON_NONE HASH_MAP_MISSING
+
+// Number of slots allocated at the start, doubled whenever they run out.
+#define MARATHON_INITIAL_CAPACITY 1024
+
+// First bytes of every snapshot file, including the format version.
+#define MARATHON_SNAPSHOT_MAGIC "MARATHN1"
+
+// Suffix of the file a snapshot is written to before it replaces
+// the previous one.
+#define MARATHON_SNAPSHOT_SUFFIX ".tmp"
+
+// Parts of the state of a user read by the cursors, which are kept
+// as they were before a change for as long as an open cursor may read
+// them. Of the movies only the changes are kept, the cursors read
+// the current set corrected by them. The slot of a removed user is kept
+// the same way, until nothing can read the user any more. All the parts
+// before the slot have their own history.
+typedef enum marathon_part_t {
+
+    MARATHON_PART_MOVIES,
+    MARATHON_PART_MAX,
+    MARATHON_PART_CHILDREN,
+    MARATHON_PART_SLOT
+
+} marathon_part_t;
+
+// State of a part of a user replaced by a change, valid for the versions
+// of the tree before until and not before the state retired before it.
+// A change of the movies keeps the movies it inserted or removed.
+typedef struct marathon_retired_t {
+
+    unsigned int user;
+    marathon_part_t part;
+    unsigned long until;
+
+    union {
+
+        struct {
+            movie_set_t movies;
+            bool inserted;
+        };
+
+        long subtreeMax;
+
+        struct {
+            unsigned int *children;
+            unsigned int childCount;
+        };
+    };
+
+    // The older and newer retired states of the same part of the user.
+    struct marathon_retired_t *older;
+    struct marathon_retired_t *newer;
+
+    // Link on the list of all the retired states.
+    dnode_t link;
+
+} marathon_retired_t;
+
+// Retired states of the parts of a user, newest first, and the versions
+// their current states have been valid since. Only kept while there
+// are any retired states.
+typedef struct marathon_history_t {
+
+    marathon_retired_t *retired[MARATHON_PART_SLOT];
+    unsigned long since[MARATHON_PART_SLOT];
+    unsigned int count;
+
+} marathon_history_t;
+
+// Data of a single user, the topology is kept separately.
+typedef struct marathon_user_t {
+
+    // Movies of the user.
+    movie_set_t movies;
+
+    // The highest rating in the user's subtree, -1 if there are none.
+    // Raises of the descendants on the list of raised users are not
+    // counted yet.
+    long subtreeMax;
+
+    // True iff the user is on the list of raised users.
+    bool raised;
+
+    // Result of the last marathon for this user and the length it was
+    // asked for, NULL if there is none or it is out of date.
+    sarray_t *cache;
+    size_t cacheLength;
+
+    // States of the user read by the open cursors, NULL if there are none.
+    marathon_history_t *history;
+
+    // Number of parent links pointing at the user, of his children and
+    // of the removed users forwarding to him. A removed user also counts
+    // the link of the open cursors that can still reach him, his slot is
+    // only released once none are left.
+    unsigned int links;
+
+} marathon_user_t;
+
+// Best movies found so far by a marathon. The heap holds at most length
+// movies with the smallest one on top, the set holds the same movies
+// for constant time duplicate checks.
+typedef struct marathon_top_t {
+
+    heap_t *heap;
+    hash_set_t *movies;
+    size_t length;
+
+} marathon_top_t;
+
+// A single position of the preorder layout. The subtree of the user
+// occupies the positions up to end, exclusive. Removed users stay
+// in the layout as tombstones with MARATHON_NONE as the user, their
+// former descendants keep their positions inside the range.
+typedef struct marathon_position_t {
+
+    unsigned int user;
+    unsigned int end;
 
-// Internal auxiliary function adding the user's movies to the list.
+    // Copy of the user's subtree maximum, so the scan never leaves
+    // the layout to decide whether to skip a subtree.
+    long subtreeMax;
+
+} marathon_position_t;
+
+// Ancestor of the position being scanned by a marathon: the end of its
+// range and the supremum its descendants inherit. A walk over the links
+// keeps the supremum inherited by the ancestor itself instead and does
+// not use the end.
+typedef struct marathon_ancestor_t {
+
+    unsigned int end;
+    long supremum;
+
+} marathon_ancestor_t;
+
+// Ancestors of the position being scanned, the closest one on top.
+typedef struct marathon_stack_t {
+
+    marathon_ancestor_t *entries;
+    size_t size;
+    size_t capacity;
+
+} marathon_stack_t;
+
+// Part of the layout range of a marathon scanned by a single task.
+// The range of the whole marathon starts at root.
+typedef struct marathon_task_t {
+
+    unsigned int root;
+    unsigned int start;
+    unsigned int end;
+
+} marathon_task_t;
+
+// Memory used by a single worker during marathons, allocated once and reused
+// by every call. Every worker gathers its own best movies, they are merged
+// into the ones of worker 0 at the end.
+typedef struct marathon_context_t {
+
+    marathon_top_t top;
+    marathon_stack_t stack;
+
+    // Number of users visited by walks since it was last collected.
+    unsigned long visited;
+
+} marathon_context_t;
+
+// Movies of a user changed after the version of a cursor, as gathered
+// by its source: the ones the user had at the version and the ones he
+// did not have. Only the movies below the one the source is at are kept.
+typedef struct marathon_delta_t {
+
+    movie_set_t present;
+    movie_set_t absent;
+
+    // The highest present movie below the one the source is at,
+    // -1 if there is none.
+    long next;
+
+} marathon_delta_t;
+
+// Source of the movies of a cursor. Until it is expanded it stands for
+// the whole subtree of the user, then only for the user's own movies,
+// read one at a time while they are above the supremum of his ancestors.
+// They are read from the current set of the user, with the movies changed
+// after the version of the cursor taken from the delta instead. Once
+// the set changes, the position in it is found again by the rating.
+// The inline movies move with the users, so they are copied.
+typedef struct marathon_source_t {
+
+    unsigned int user;
+    bool expanded;
+    long supremum;
+
+    // The movie the source is at.
+    long movie;
+
+    // Position of the next movie in the current set, valid while it has not
+    // changed after the version synced. The changes up to it are in delta,
+    // which stays NULL until there are any.
+    movie_set_block_t block;
+    size_t position;
+    int movies[MOVIE_SET_INLINE];
+    unsigned long synced;
+    marathon_delta_t *delta;
+
+} marathon_source_t;
+
+// Marathon being read in parts. The heap holds the sources with their
+// next movies, or subtree maxima if they are not expanded yet, as negated
+// keys, so the best one is on the top.
+struct marathon_cursor_t {
+
+    heap_t *heap;
+    marathon_source_t *sources;
+    size_t sourceCount;
+    size_t sourceCapacity;
+
+    // The movie returned last, repeated ones are skipped.
+    long last;
+
+    // Version of the tree the cursor reads, the one it was opened on.
+    unsigned long version;
+
+    // Link on the list of the open cursors.
+    dnode_t link;
+
+};
+
+// Rating of an addMovies or delMovies batch with its position in the batch.
+typedef struct marathon_batch_entry_t {
+
+    int movie;
+    size_t position;
+
+} marathon_batch_entry_t;
+
+// Header of a snapshot file. It is followed by userCount user entries,
+// parents before their children, and movieCount movies, 32-bit ratings
+// in descending order for every user. All numbers are in the byte order
+// of the machine and there are no pointers, only offsets.
+typedef struct marathon_snapshot_header_t {
+
+    char magic[8];
+    uint32_t userCount;
+    uint32_t reserved;
+    uint64_t movieCount;
+
+} marathon_snapshot_header_t;
+
+// A single user of a snapshot. Movies are counted from the first one
+// after the user entries.
+typedef struct marathon_snapshot_user_t {
+
+    uint32_t userID;
+    uint32_t parentID;
+    uint32_t movieCount;
+    uint32_t reserved;
+    uint64_t movieOffset;
+
+} marathon_snapshot_user_t;
+
+// Every user occupies a slot in the dense arrays below, the map gives
+// the slot of each userID. Slots of removed users are reused first, so
+// the arrays only grow with the number of users alive at the same time.
+static hash_map_t *slots = NULL;
+static unsigned int slotCount = 0;
+static unsigned int slotCapacity = 0;
+
+// Free slots, linked through nextSiblings.
+static unsigned int freeSlots = MARATHON_NONE;
+
+// Users whose subtree maxima have been raised above the ones of their
+// parents, each at most once. The ancestors are only raised in bulk
+// before the maxima are read, so no change walks the path to the root.
+static unsigned int *raisedUsers = NULL;
+static unsigned int raisedCount = 0;
+
+// Topology of the tree, indexed by slot. Children of every user form
+// a doubly linked list threaded through the sibling arrays, MARATHON_NONE
+// marks the ends of the lists and the parent of the root. The parent
+// of a user may be a removed one, which forwards to his own parent.
+static unsigned int *parents = NULL;
+static unsigned int *firstChildren = NULL;
+static unsigned int *lastChildren = NULL;
+static unsigned int *nextSiblings = NULL;
+static unsigned int *prevSiblings = NULL;
+
+// Data and userID of every user, indexed by slot. The userID of a free
+// slot is MARATHON_NONE.
+static marathon_user_t *users = NULL;
+static unsigned int *userIDs = NULL;
+
+// Users in preorder, so every subtree is a contiguous range, and
+// the position of every user, indexed by slot. Removing a user leaves
+// a tombstone and keeps the order of the others, adding one invalidates
+// the layout.
+static marathon_position_t *layout = NULL;
+static unsigned int *positions = NULL;
+static bool layoutValid = false;
+
+// Users visited by marathons walking the links since the layout became
+// invalid. It is rebuilt once they outnumber the users, so the rebuilds
+// never cost more than the marathons would without them.
+static unsigned long layoutDebt = 0;
+
+// Memory of all the workers and the pool running them,
+// NULL if there is only one.
+static marathon_context_t *contexts = NULL;
+static unsigned int threadCount = 0;
+static thread_pool_t *pool = NULL;
+
+// Number of users currently holding a cached marathon result.
+static size_t cachedUsers = 0;
+
+// Number of changes of the tree so far. Every change is counted before
+// it is made, so the states it replaces are valid until this version.
+static unsigned long treeVersion = 0;
+
+// Version made by the last load, cursors opened before it are stale.
+static unsigned long loadVersion = 0;
+
+// Open cursors that are not stale, the oldest first, so their versions
+// never decrease.
+static dlist_t openCursors;
+
+// States retired while an open cursor could read them, in the order
+// of retiring, so that their versions never decrease either. They are
+// released once the oldest open cursor is not older than them.
+static dlist_t retiredStates;
+
+// Memory of the retired states and of the histories.
+static arena_t *retiredArena = NULL;
+static arena_t *historyArena = NULL;
+
+// Number of users whose movies have been promoted to a tree, the rest
+// of them keep the movies inline.
+static unsigned long promotedSets = 0;
+
+// Guards the cached results and the statistics while marathons
+// are calculated concurrently.
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Number of marathons answered from and not from the cache.
+static unsigned long cacheHits = 0;
+static unsigned long cacheMisses = 0;
+
+// Internal auxiliary function giving the user visited after the given
+// one in preorder, MARATHON_NONE after the last one.
+static unsigned int marathon_tree_next_preorder(unsigned int user);
+
+// Internal auxiliary function checking that the snapshot of given size
+// describes a correct tree.
+static bool marathon_tree_check_snapshot(const char *snapshot, size_t size);
+
+// Internal auxiliary function replacing the tree with the one described
+// by a correct snapshot.
+static void marathon_tree_build_snapshot(const char *snapshot);
+
+// Internal auxiliary function synchronising the directory holding the file
+// at the given path to the disk. Returns true iff it succeeded.
+static bool marathon_tree_sync_directory(const char *path);
+
+// Internal auxiliary function giving the marathon list using the memory
+// of the given worker. Large subtrees are split between the workers
+// if split is set, which is only allowed for worker 0.
+static sarray_t *marathon_tree_marathon_list(unsigned int userID, long k,
+                                             unsigned int worker, bool split);
+
+// Internal auxiliary function calculating the marathon list into the best
+// movies of the given worker.
+static void marathon_tree_calculate_marathon_list(unsigned int user,
+                                                  size_t k,
+                                                  unsigned int worker,
+                                                  bool split);
+
+// Internal auxiliary function scanning the positions from start to end
+// of the layout range beginning at root, adding the movies above
+// the supremum of their ancestors to the best ones. Skips the subtrees
+// that cannot contribute to the result.
+static void marathon_tree_scan(marathon_context_t *context, unsigned int root,
+                               unsigned int start, unsigned int end);
+
+// Internal auxiliary function visiting the user's subtree in preorder
+// by following the links, for when the layout is not valid. Adds
+// the movies and skips the subtrees the same way as the scan.
+static void marathon_tree_walk(marathon_context_t *context, unsigned int user);
+
+// Internal auxiliary function filling the stack with the ancestors
+// of the first user at or after start, up to the user at root.
+static void marathon_tree_enter_range(marathon_stack_t *stack,
+                                      unsigned int root, unsigned int start,
+                                      unsigned int end);
+
+// Internal auxiliary function pushing an ancestor on the stack.
+static void marathon_tree_push_ancestor(marathon_stack_t *stack,
+                                        unsigned int end, long supremum);
+
+// Internal auxiliary function rebuilding the layout if it is not valid
+// and the marathons have already visited enough users without it.
+static void marathon_tree_prepare_layout();
+
+// Internal function of the tasks, calculating the marathon list
+// for a part of a range into the best movies of the worker.
+static void marathon_tree_run_task(void *arg, unsigned int worker);
+
+// Internal function of the tasks, answering a single query of a batch.
+static void marathon_tree_run_query(void *arg, unsigned int worker);
+
+// Internal auxiliary function adding the user's movies to the best ones.
 static void
-marathon_tree_add_movies_to_marathon_list(tree_t *user, long *remainingSpace,
-                                          dlist_t **resultMovieList,
-                                          long threshold);
+marathon_tree_add_movies_to_marathon_list(unsigned int user,
+                                          marathon_top_t *top, long threshold);
+
+// Internal auxiliary function adding the movie to the best ones if it
+// is good enough. Returns false iff it is too small to be added.
+static bool marathon_tree_offer_movie(marathon_top_t *top, long movie);
+
+// Internal auxiliary function returning the highest rating of the user
+// or -1 if he has none.
+static long marathon_tree_get_max(unsigned int user);
+
+// Internal auxiliary function returning the highest rating in the user's
+// subtree or -1 if there are none.
+static long marathon_tree_get_subtree_max(unsigned int user);
+
+// Internal auxiliary function changing the user's subtree maximum,
+// together with its copy in the layout.
+static void marathon_tree_set_subtree_max(unsigned int user, long subtreeMax);
+
+// Internal auxiliary function recalculating the subtree maxima from
+// the user up to the root, stopping as soon as one does not change.
+// Every user on the way has all of his children visited.
+static void marathon_tree_update_subtree_max(unsigned int user);
+
+// Internal auxiliary function raising the user's subtree maximum to the
+// rating and putting him on the list of raised users if it went up.
+static void marathon_tree_raise_subtree_max(unsigned int user, long rating);
+
+// Internal auxiliary function passing the raised subtree maxima on to
+// the ancestors, the highest first, so that no user is raised twice.
+// Takes O(r log r + a) time, where r is the number of raised users
+// and a is the number of ancestors raised.
+static void marathon_tree_raise_ancestors();
+
+// Internal auxiliary function ordering raised users by descending
+// subtree maxima.
+static int marathon_tree_compare_raised(const void *first,
+                                        const void *second);
+
+// Internal auxiliary function applying the batch of ratings to the user's
+// movies, inserting or removing them. Sets results as if the ratings
+// were applied one by one, so only the first of repeated ones can succeed.
+// Returns the highest rating that was applied, -1 if none was.
+static long marathon_tree_apply_batch(unsigned int user, const int *movies,
+                                      size_t count, bool *results,
+                                      bool insert);
+
+// Internal auxiliary function adding a source for the user's subtree
+// to the cursor, unless none of its movies are above the supremum.
+static void marathon_tree_cursor_push_user(marathon_cursor_t *cursor,
+                                           unsigned int user, long supremum);
+
+// Internal auxiliary function replacing the subtree source with one for
+// the user's own movies and sources for the subtrees of his children.
+static void marathon_tree_cursor_expand(marathon_cursor_t *cursor,
+                                        size_t source);
+
+// Internal auxiliary function moving the source to the user's next movie
+// at the version of the cursor, syncing it first if the set has changed.
+// Returns it or -1 if there are no more.
+static long marathon_tree_cursor_advance(marathon_source_t *source);
+
+// Internal auxiliary function giving the movie at the position
+// of the source in the current set.
+static long marathon_tree_cursor_movie(const marathon_source_t *source);
+
+// Internal auxiliary function gathering the changes of the user's movies
+// made after the version the source has synced, then finding its position
+// in the current set again.
+static void marathon_tree_cursor_sync(marathon_source_t *source);
+
+// Internal auxiliary function adding the movies of the retired change
+// to the delta of the source, unless an older change has already decided
+// whether the cursor has them.
+static void marathon_tree_cursor_gather(marathon_source_t *source,
+                                        const marathon_retired_t *state);
+
+// Internal auxiliary function releasing the deltas of the cursor's sources.
+static void marathon_tree_release_deltas(marathon_cursor_t *cursor);
+
+// Internal auxiliary function giving the oldest state of the part of the user
+// retired after the version, NULL if the current state is the one valid
+// at the version.
+static marathon_retired_t *marathon_tree_retired_state(unsigned int user,
+                                                       marathon_part_t part,
+                                                       unsigned long version);
+
+// Internal auxiliary function keeping the current state of the part of
+// the user, before it is changed, if an open cursor could read it.
+// Returns the retired state, NULL if none was needed. The movies are not
+// kept, the caller records the change with marathon_tree_retire_movies.
+static marathon_retired_t *marathon_tree_retire(unsigned int user,
+                                                marathon_part_t part);
+
+// Internal auxiliary function recording the change of the user's movies,
+// which inserted or removed the count movies given in descending order,
+// if an open cursor could read them.
+static void marathon_tree_retire_movies(unsigned int user, const int *movies,
+                                        size_t count, bool inserted);
+
+// Internal auxiliary function making a new retired state of the part
+// of the user, valid until the current version, with nothing kept yet.
+static marathon_retired_t *marathon_tree_make_retired(unsigned int user,
+                                                      marathon_part_t part);
+
+// Internal auxiliary function releasing the retired states the oldest
+// open cursor cannot read, all of them if there are no cursors.
+static void marathon_tree_reclaim();
+
+// Internal auxiliary function releasing the retired state, the oldest one
+// of its part of the user.
+static void marathon_tree_release_retired(marathon_retired_t *state);
+
+// Internal auxiliary function ordering batch entries by descending ratings,
+// repeated ones by their positions.
+static int marathon_tree_compare_batch_entries(const void *first,
+                                               const void *second);
+
+// Internal auxiliary function dropping the cached marathon results
+// of the user and all his ancestors.
+static void marathon_tree_invalidate_cache(unsigned int user);
+
+// Internal auxiliary function dropping the cached marathon result
+// of a single user.
+static void marathon_tree_drop_cache(marathon_user_t *data);
+
+// Internal auxiliary function making a new user with no movies and no links.
+// Returns the slot of the user.
+static unsigned int marathon_tree_make_user(unsigned int userID);
+
+// Internal auxiliary function appending the user at the end
+// of the parent's children list.
+static void marathon_tree_link_child(unsigned int parent, unsigned int user);
+
+// Internal auxiliary function returning the slot of the user of given id
+// or MARATHON_NONE if such user does not exist.
+static unsigned int marathon_tree_find(unsigned int userID);
+
+// Internal auxiliary function returning the parent of the user, following
+// the links of the removed users on the way. Changes nothing, so the
+// marathons can use it concurrently.
+static unsigned int marathon_tree_parent(unsigned int user);
+
+// Internal auxiliary function returning the parent of the user like
+// marathon_tree_parent, but pointing the user and the removed users
+// on the way straight at him, so that later lookups are shorter.
+static unsigned int marathon_tree_compress_parent(unsigned int user);
+
+// Internal auxiliary function dropping a parent link pointing at the user.
+// A removed user left with no links is released.
+static void marathon_tree_drop_link(unsigned int user);
+
+// Internal function removing a single user and releasing his resources.
+// His slot is only released once no parent links point at him, and
+// together with his movies once no open cursor can read him any more.
+static void marathon_tree_destroy_user(unsigned int user);
+
+// Internal function releasing the movies and the slot of a removed user
+// with no links left, then dropping his own link to his parent.
+static void marathon_tree_release_user(unsigned int user);
+
+// Internal function releasing all the users at once. Slots are given out
+// from zero again afterwards.
+static void marathon_tree_destroy_users();
+
+// Internal auxiliary function changing the number of allocated slots.
+static void marathon_tree_reserve(unsigned int capacity);
+
 
-// Internal auxiliary function returning a vertex of given id or NULL if such
-// user does not exist.
-static tree_t *marathon_tree_get_vertex(unsigned int userID);
+void marathon_tree_initialize(unsigned int threads) {
 
-// Internal function releasing resources for a single vertex.
-static void marathon_tree_destroy_vertex(tree_t **vertex);
+    ISNULL(users, "marathon_tree_initialize");
 
-// Recursively destroy all vertices and release their resources, rooted in user.
-static void marathon_tree_destroy(tree_t **user);
+    slots = hash_map_make();
 
+    dlist_init(&openCursors);
+    dlist_init(&retiredStates);
 
-void marathon_tree_initialize() {
+    retiredArena = arena_make(sizeof(marathon_retired_t));
+    historyArena = arena_make(sizeof(marathon_history_t));
 
-    ISNULL(root, "marathon_tree_initialize");
+    marathon_tree_reserve(MARATHON_INITIAL_CAPACITY);
 
-    users = calloc(MAX_USER + 1, sizeof(dnode_t *));
+    marathon_tree_make_user(MARATHON_ROOT);
+
+    threadCount = threads > 0 ? threads : 1;
+    contexts = malloc(threadCount * sizeof(marathon_context_t));
 
     // Assure alloc did not fail.
-    NNULL(users, "marathon_tree_initialize");
+    NNULL(contexts, "contexts/marathon_tree_initialize");
+
+    for(unsigned int i = 0; i < threadCount; ++i) {
+
+        contexts[i].top.heap = heap_make();
+        contexts[i].top.movies = hash_set_make();
+        contexts[i].top.length = 0;
+
+        contexts[i].stack.entries = NULL;
+        contexts[i].stack.size = 0;
+        contexts[i].stack.capacity = 0;
+        contexts[i].visited = 0;
+    }
 
-    root = tree_make(dlist_make_list());
+    if(threadCount > 1) {
+        pool = thread_pool_make(threadCount);
+    }
 }
 
 void marathon_tree_cleanup() {
 
-    NNULL(root, "root/marathon_tree_cleanup");
     NNULL(users, "users/marathon_tree_cleanup");
 
-    marathon_tree_destroy(&root);
+    marathon_tree_destroy_users();
+
+    hash_map_destroy(&slots);
+
+    arena_destroy(&retiredArena);
+    arena_destroy(&historyArena);
 
     free(users);
+    free(userIDs);
+    free(layout);
+    free(positions);
+    free(parents);
+    free(firstChildren);
+    free(lastChildren);
+    free(nextSiblings);
+    free(prevSiblings);
+    free(raisedUsers);
+
+    users = NULL;
+    slotCapacity = 0;
+    layoutValid = false;
+
+    if(pool != NULL) {
+        thread_pool_destroy(&pool);
+    }
+
+    for(unsigned int i = 0; i < threadCount; ++i) {
+
+        heap_destroy(&contexts[i].top.heap);
+        hash_set_destroy(&contexts[i].top.movies);
+
+        free(contexts[i].stack.entries);
+    }
+
+    free(contexts);
 }
 
 bool marathon_tree_add(unsigned int parentID, unsigned int userID) {
 
-    tree_t *parent = marathon_tree_get_vertex(parentID);
-    tree_t *oldUser = marathon_tree_get_vertex(userID);
+    unsigned int parent = marathon_tree_find(parentID);
 
     // Parent is dead or the user already exists.
-    if(parent == NULL || oldUser != NULL) {
+    if(parent == MARATHON_NONE || marathon_tree_find(userID) != MARATHON_NONE) {
         return false;
     }
 
-    tree_t *user = tree_make(dlist_make_list());
+    ++treeVersion;
+
+    // The new user has no movies, so no subtree maxima
+    // and no marathon results change.
+    unsigned int user = marathon_tree_make_user(userID);
 
     // Adds user to the end of the parent's children list.
-    tree_add(parent, user);
+    marathon_tree_retire(parent, MARATHON_PART_CHILDREN);
+    marathon_tree_link_child(parent, user);
 
-    users[userID] = dlist_get_back(parent->children);
+    // The user belongs in the middle of the layout.
+    layoutValid = false;
 
     return true;
 }
 
 bool marathon_tree_remove(unsigned int userID) {
 
-    tree_t *user = marathon_tree_get_vertex(userID);
+    unsigned int user = marathon_tree_find(userID);
 
     // Can never delete a root or a dead user.
-    if(user == NULL || user == root) {
+    if(userID == MARATHON_ROOT || user == MARATHON_NONE) {
         return false;
     }
 
-    dnode_t *userNode = users[userID];
-    dnode_t *prevNode = userNode->prev;
+    // The parent's maximum is compared with the user's movies.
+    marathon_tree_raise_ancestors();
+
+    unsigned int parent = marathon_tree_compress_parent(user);
+
+    ++treeVersion;
+
+    marathon_tree_retire(parent, MARATHON_PART_CHILDREN);
+    marathon_tree_retire(user, MARATHON_PART_CHILDREN);
+
+    // The children are adopted by the parent without being visited,
+    // their links to the user forward to him from now on.
 
     // Remove the user from his parent's children list,
     // but link all of user's children to that list in his place.
-    // Since it is only a few pointers reattached the time is constant.
-    dlist_remove(userNode);
+    // Since it is only a few indices rewritten the time is constant.
+    unsigned int before = prevSiblings[user];
+    unsigned int after = nextSiblings[user];
+    unsigned int first = firstChildren[user];
+    unsigned int last = lastChildren[user];
+
+    if(first != MARATHON_NONE) {
+
+        prevSiblings[first] = before;
+        nextSiblings[last] = after;
+    }
+    else {
+
+        first = after;
+        last = before;
+    }
+
+    if(before != MARATHON_NONE) {
+        nextSiblings[before] = first;
+    }
+    else {
+        firstChildren[parent] = first;
+    }
+
+    if(after != MARATHON_NONE) {
+        prevSiblings[after] = last;
+    }
+    else {
+        lastChildren[parent] = last;
+    }
+
+    // The parent's subtree maximum can only change if it was one
+    // of the user's own movies.
+    bool maxRemoved = marathon_tree_get_max(user) >= 0 &&
+                      marathon_tree_get_max(user) ==
+                      marathon_tree_get_subtree_max(parent);
+
+    // Results of the ancestors only change if the user had any movies,
+    // the children's results do not depend on their ancestors.
+    if(marathon_tree_get_max(user) >= 0) {
+        marathon_tree_invalidate_cache(parent);
+    }
 
-    dlist_insert_list_after(prevNode, user->children);
+    // The children keep their positions inside the parent's range.
+    if(layoutValid) {
+        layout[positions[user]].user = MARATHON_NONE;
+    }
 
-    marathon_tree_destroy(&user);
+    marathon_tree_destroy_user(user);
 
-    users[userID] = NULL;
+    if(maxRemoved) {
+        marathon_tree_update_subtree_max(parent);
+    }
 
     return true;
 }
 
 bool marathon_tree_add_movie(unsigned int userID, long movieRating) {
 
-    tree_t *user = marathon_tree_get_vertex(userID);
+    unsigned int user = marathon_tree_find(userID);
 
-    if(user == NULL) {
+    if(user == MARATHON_NONE) {
         return false;
     }
 
-    dlist_t *movieList = user->value;
+    movie_set_t *movies = &users[user].movies;
+    int movie = (int) movieRating;
 
-    dnode_t *iter = movieList->head;
+    ++treeVersion;
 
-    // Skip over greater elements.
-    while(dlist_next(iter) != NULL &&
-          dlist_next(iter)->elem.num > movieRating) {
+    bool promoted = movies->promoted;
 
-        iter = iter->next;
+    // Only inserts if the movie is not already in the set.
+    if(!movie_set_insert(movies, movie)) {
+        return false;
     }
 
-    // Only insert if the element is already on the list.
-    if(dlist_next(iter) == NULL || dlist_next(iter)->elem.num != movieRating) {
+    marathon_tree_retire_movies(user, &movie, 1, true);
 
-        dlist_insert_after(iter, dlist_make_elem_num(movieRating));
-
-        return true;
+    if(movies->promoted && !promoted) {
+        ++promotedSets;
     }
 
-    return false;
+    marathon_tree_invalidate_cache(user);
+
+    marathon_tree_raise_subtree_max(user, movieRating);
+
+    return true;
 }
 
 bool marathon_tree_remove_movie(unsigned int userID, long movieRating) {
 
-    tree_t *user = marathon_tree_get_vertex(userID);
+    unsigned int user = marathon_tree_find(userID);
+
+    if(user == MARATHON_NONE) {
+        return false;
+    }
+
+    marathon_user_t *data = &users[user];
+    int movie = (int) movieRating;
+
+    // The maxima are recalculated from the ones of the children.
+    marathon_tree_raise_ancestors();
+
+    ++treeVersion;
+
+    bool promoted = data->movies.promoted;
 
-    if(user == NULL) {
+    // Only removes the movie if it exists.
+    if(!movie_set_remove(&data->movies, movie)) {
         return false;
     }
 
-    dlist_t *movieList = user->value;
+    marathon_tree_retire_movies(user, &movie, 1, false);
 
-    dnode_t *iter = dlist_get_front(movieList);
+    if(promoted && !data->movies.promoted) {
+        --promotedSets;
+    }
+
+    marathon_tree_invalidate_cache(user);
+
+    if(data->subtreeMax == movieRating) {
+        marathon_tree_update_subtree_max(user);
+    }
+
+    return true;
+}
+
+bool marathon_tree_add_movies(unsigned int userID, const int *movies,
+                              size_t count, bool *added) {
 
-    // Skip over greater elements.
-    while(dlist_is_valid(iter) && iter->elem.num > movieRating) {
-        iter = dlist_next(iter);
+    unsigned int user = marathon_tree_find(userID);
+
+    if(user == MARATHON_NONE) {
+        return false;
     }
 
-    // Check if the movie exists on the list.
-    if(dlist_is_valid(iter) && iter->elem.num == movieRating) {
+    ++treeVersion;
 
-        dlist_remove(iter);
+    long maxAdded = marathon_tree_apply_batch(user, movies, count, added, true);
 
+    if(maxAdded < 0) {
         return true;
     }
 
-    return false;
+    marathon_tree_invalidate_cache(user);
 
+    // Only the best of the new movies can raise the maxima.
+    marathon_tree_raise_subtree_max(user, maxAdded);
+
+    return true;
 }
 
-dlist_t *marathon_tree_get_marathon_list(unsigned int userID, long k) {
+bool marathon_tree_remove_movies(unsigned int userID, const int *movies,
+                                 size_t count, bool *removed) {
 
-    tree_t *user = marathon_tree_get_vertex(userID);
+    unsigned int user = marathon_tree_find(userID);
 
-    if(user == NULL) {
-        return NULL;
+    if(user == MARATHON_NONE) {
+        return false;
     }
 
-    // Make sure we do not go through the entire tree
-    // needlessly in the corner case.
-    if(k == 0) {
-        return dlist_make_list();
+    // The maxima are recalculated from the ones of the children.
+    marathon_tree_raise_ancestors();
+
+    ++treeVersion;
+
+    long maxRemoved = marathon_tree_apply_batch(user, movies, count, removed,
+                                                false);
+
+    if(maxRemoved < 0) {
+        return true;
     }
 
-    dlist_t *resultMovieList = dlist_make_list();
+    marathon_tree_invalidate_cache(user);
 
-    // Calculate the list recursively.
-    // Initial supremum can be -1 because all movie rating's are >= 0.
-    marathon_tree_calculate_marathon_list(user, &k, &resultMovieList, -1);
+    // The maximum can only be among the removed movies if it is the best
+    // of them.
+    if(users[user].subtreeMax == maxRemoved) {
+        marathon_tree_update_subtree_max(user);
+    }
 
-    return resultMovieList;
+    return true;
 }
 
-static void
-marathon_tree_calculate_marathon_list(tree_t *user, long *remainingSpace,
-                                      dlist_t **resultMovieList,
-                                      long supremum) {
+bool marathon_tree_save(const char *path) {
 
-    dnode_t *iter = dlist_get_front(user->value);
+    size_t userCount = 0;
+    size_t movieCount = 0;
 
-    // Get the new supremum for this subtree.
-    long newSupremum = supremum;
+    for(unsigned int user = MARATHON_ROOT; user != MARATHON_NONE;
+        user = marathon_tree_next_preorder(user)) {
 
-    if(dlist_is_valid(iter) && iter->elem.num > newSupremum) {
-        newSupremum = iter->elem.num;
+        ++userCount;
+        movieCount += users[user].movies.size;
     }
 
-    // Update the list with values from this user's movie list.
-    marathon_tree_add_movies_to_marathon_list(user, remainingSpace,
-                                              resultMovieList,
-                                              supremum);
+    size_t size = sizeof(marathon_snapshot_header_t) +
+                  userCount * sizeof(marathon_snapshot_user_t) +
+                  movieCount * sizeof(int32_t);
 
-    // Recurse over children nodes.
-    dnode_t *childIter = dlist_get_front(user->children);
+    char *snapshot = malloc(size);
 
-    while(dlist_is_valid(childIter)) {
+    // Assure that malloc has not failed.
+    NNULL(snapshot, "marathon_tree_save");
 
-        marathon_tree_calculate_marathon_list(childIter->elem.ptr,
-                                              remainingSpace,
-                                              resultMovieList, newSupremum);
+    marathon_snapshot_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MARATHON_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.userCount = (uint32_t) userCount;
+    header.movieCount = movieCount;
 
-        childIter = dlist_next(childIter);
-    }
-}
+    memcpy(snapshot, &header, sizeof(header));
 
-// Adds the elements from the user's movie list to the resultMovieList.
-// Ignores elements lower than the threshold. Extends the list by at most
-// remainingSpace elements. Tries to maximise the elements on the list by
-// removing lowest elements when remainingSpace is zero.
-static void
-marathon_tree_add_movies_to_marathon_list(tree_t *user, long *remainingSpace,
-                                          dlist_t **resultMovieList,
-                                          long threshold) {
+    char *entries = snapshot + sizeof(header);
+    char *movies = entries + userCount * sizeof(marathon_snapshot_user_t);
+    size_t movieOffset = 0;
 
-    dnode_t *iter = dlist_get_front(user->value);
-    dnode_t *resultIter = (*resultMovieList)->head;
+    for(unsigned int user = MARATHON_ROOT; user != MARATHON_NONE;
+        user = marathon_tree_next_preorder(user)) {
 
-    // Update the list with user's movies, assuring they are bigger
-    // than the threshold.
-    // If the list is less than remainingSpace in length adds another element.
-    // Otherwise replaces the smallest movie currently on the list.
-    while(dlist_is_valid(iter) && iter->elem.num > threshold) {
+        marathon_user_t *data = &users[user];
 
-        // Skip over greater elements.
-        while(dlist_next(resultIter) != NULL &&
-              dlist_next(resultIter)->elem.num > iter->elem.num) {
+        marathon_snapshot_user_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.userID = userIDs[user];
+        entry.parentID = user == MARATHON_ROOT
+                         ? MARATHON_ROOT
+                         : userIDs[marathon_tree_parent(user)];
+        entry.movieCount = data->movies.size;
+        entry.movieOffset = movieOffset;
 
-            resultIter = dlist_next(resultIter);
+        memcpy(entries, &entry, sizeof(entry));
+        entries += sizeof(entry);
+
+        // Ratings are non-negative ints, the same as their 32-bit form.
+        for(movie_set_block_t block = movie_set_first_block(&data->movies);
+            block.size > 0; block = movie_set_next_block(block)) {
+
+            memcpy(movies + movieOffset * sizeof(int32_t), block.data,
+                   block.size * sizeof(int32_t));
+            movieOffset += block.size;
         }
-        dnode_t *next = dlist_next(resultIter);
+    }
+
+    // The old snapshot is only replaced once the new one is complete,
+    // so a crash while saving leaves one of them whole.
+    size_t pathLength = strlen(path);
+    char *temporary = malloc(pathLength + sizeof(MARATHON_SNAPSHOT_SUFFIX));
 
-        // If we can add another element.
-        if(*remainingSpace > 0 &&
-           (next == NULL || next->elem.num != iter->elem.num)) {
+    // Assure that malloc has not failed.
+    NNULL(temporary, "temporary/marathon_tree_save");
 
-            dlist_insert_after(resultIter, dlist_make_elem_num(iter->elem.num));
-            --(*remainingSpace);
+    memcpy(temporary, path, pathLength);
+    memcpy(temporary + pathLength, MARATHON_SNAPSHOT_SUFFIX,
+           sizeof(MARATHON_SNAPSHOT_SUFFIX));
+
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    size_t written = 0;
+
+    while(fd >= 0 && written < size) {
+
+        ssize_t bytesWritten = write(fd, snapshot + written, size - written);
+
+        if(bytesWritten < 0 && errno != EINTR) {
+            break;
         }
-        else if(next != NULL && next->elem.num != iter->elem.num) {
 
-            // Get the smallest element, move him to after iter and
-            // update its contained value.
-            dnode_t *smallest = dlist_get_back(*resultMovieList);
+        if(bytesWritten > 0) {
+            written += (size_t) bytesWritten;
+        }
+    }
+
+    free(snapshot);
+
+    // The snapshot is only complete once it is on the disk.
+    bool saved = fd >= 0 && written == size && fsync(fd) == 0;
+
+    if(fd >= 0 && close(fd) != 0) {
+        saved = false;
+    }
+
+    // The new name is only durable once the directory is on the disk.
+    saved = saved && rename(temporary, path) == 0 &&
+            marathon_tree_sync_directory(path);
+
+    if(!saved && fd >= 0) {
+        unlink(temporary);
+    }
+
+    free(temporary);
+
+    return saved;
+}
+
+bool marathon_tree_load(const char *path) {
+
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0) {
+        return false;
+    }
+
+    struct stat status;
+
+    if(fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) ||
+       (size_t) status.st_size < sizeof(marathon_snapshot_header_t)) {
+
+        close(fd);
+
+        return false;
+    }
+
+    size_t size = (size_t) status.st_size;
+    void *snapshot = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if(snapshot == MAP_FAILED) {
+        return false;
+    }
+
+    // The file is read sequentially, once.
+    posix_madvise(snapshot, size, POSIX_MADV_SEQUENTIAL);
+
+    bool loaded = marathon_tree_check_snapshot(snapshot, size);
+
+    if(loaded) {
+
+        loadVersion = ++treeVersion;
+
+        marathon_tree_build_snapshot(snapshot);
+    }
+
+    munmap(snapshot, size);
+
+    return loaded;
+}
+
+sarray_t *marathon_tree_get_marathon_list(unsigned int userID, long k) {
+
+    marathon_tree_prepare_layout();
+
+    return marathon_tree_marathon_list(userID, k, 0, pool != NULL);
+}
+
+void marathon_tree_run_queries(marathon_query_t *queries, size_t count) {
 
-            dlist_insert_node_after(resultIter, smallest);
+    if(pool == NULL || count == 1) {
 
-            smallest->elem.num = iter->elem.num;
+        for(size_t i = 0; i < count; ++i) {
+            queries[i].result = marathon_tree_get_marathon_list(
+                    queries[i].userID, queries[i].k);
         }
 
-        iter = dlist_next(iter);
+        return;
+    }
+
+    // The workers only read the layout.
+    marathon_tree_prepare_layout();
+
+    // Every query is answered by a single worker, spread them evenly.
+    for(size_t i = 0; i < count; ++i) {
+        thread_pool_submit(pool, (unsigned int) (i % threadCount),
+                           marathon_tree_run_query, &queries[i]);
     }
+
+    thread_pool_run(pool);
 }
 
-static tree_t *marathon_tree_get_vertex(unsigned int userID) {
+marathon_cursor_t *marathon_tree_open_cursor(unsigned int userID) {
+
+    unsigned int user = marathon_tree_find(userID);
 
-    if(userID > MAX_USER) {
+    if(user == MARATHON_NONE) {
         return NULL;
     }
 
-    if(userID == 0) {
-        return root;
-    }
+    // The cursor reads the maxima as they are at its version, later
+    // raises of the ancestors are retired like any other change.
+    marathon_tree_raise_ancestors();
+
+    marathon_cursor_t *cursor = malloc(sizeof(marathon_cursor_t));
+
+    // Assure that malloc has not failed.
+    NNULL(cursor, "marathon_tree_open_cursor");
+
+    cursor->heap = heap_make();
+    cursor->sources = NULL;
+    cursor->sourceCount = 0;
+    cursor->sourceCapacity = 0;
+    cursor->last = -1;
+    cursor->version = treeVersion;
 
-    dnode_t *userLocation = users[userID];
+    // The versions of the cursors on the list never decrease.
+    dlist_push_back(&openCursors, &cursor->link);
 
-    if(userLocation == NULL) {
+    // All the user's own movies count.
+    marathon_tree_cursor_push_user(cursor, user, -1);
+
+    return cursor;
+}
+
+sarray_t *marathon_tree_cursor_next(marathon_cursor_t *cursor, long n) {
+
+    NNULL(cursor, "marathon_tree_cursor_next");
+
+    if(cursor->version < loadVersion) {
         return NULL;
     }
 
-    return userLocation->elem.ptr;
+    sarray_t *movies = sarray_make();
+    heap_t *heap = cursor->heap;
+
+    while((long) movies->size < n && heap->size > 0) {
+
+        heap_elem_t best = heap_top(heap);
+        marathon_source_t *source = &cursor->sources[best.value];
+
+        // No movie can come before the best one of the subtree,
+        // so it is only expanded once it is needed.
+        if(!source->expanded) {
+
+            heap_pop(heap);
+            marathon_tree_cursor_expand(cursor, (size_t) best.value);
+
+            continue;
+        }
+
+        long movie = -best.key;
+
+        // The same movie can be given by many users.
+        if(movie != cursor->last) {
+
+            sarray_push_back(movies, (int) movie);
+            cursor->last = movie;
+        }
+
+        long next = marathon_tree_cursor_advance(source);
+
+        if(next > source->supremum) {
+            heap_replace_top(heap, heap_make_elem(-next, best.value));
+        }
+        else {
+            heap_pop(heap);
+        }
+    }
+
+    return movies;
 }
 
-static void marathon_tree_destroy_vertex(tree_t **vertex) {
+void marathon_tree_close_cursor(marathon_cursor_t **cursor) {
 
-    if(*vertex == NULL) {
-        return;
+    NNULL(*cursor, "marathon_tree_close_cursor");
+
+    // Stale cursors have already been taken off the list.
+    if((*cursor)->link.next != NULL) {
+
+        dlist_remove(&(*cursor)->link);
+
+        marathon_tree_release_deltas(*cursor);
+        marathon_tree_reclaim();
     }
 
-    dlist_destroy((dlist_t **) &(*vertex)->value);
-    tree_destroy(vertex);
+    heap_destroy(&(*cursor)->heap);
+    free((*cursor)->sources);
+    free(*cursor);
+
+    *cursor = NULL;
 }
 
-static void marathon_tree_destroy(tree_t **user) {
+void marathon_tree_get_set_stats(unsigned long *inlineSets,
+                                 unsigned long *treeSets) {
 
-    if(*user == NULL) {
-        return;
+    *inlineSets = slots->size - promotedSets;
+    *treeSets = promotedSets;
+}
+
+void marathon_tree_get_cache_stats(unsigned long *hits,
+                                   unsigned long *misses) {
+
+    pthread_mutex_lock(&cacheLock);
+
+    *hits = cacheHits;
+    *misses = cacheMisses;
+
+    pthread_mutex_unlock(&cacheLock);
+}
+
+static sarray_t *marathon_tree_marathon_list(unsigned int userID, long k,
+                                             unsigned int worker, bool split) {
+
+    unsigned int user = marathon_tree_find(userID);
+
+    if(user == MARATHON_NONE) {
+        return NULL;
+    }
+
+    // Make sure we do not go through the entire tree
+    // needlessly in the corner case.
+    if(k == 0) {
+        return sarray_make();
+    }
+
+    marathon_user_t *data = &users[user];
+
+    pthread_mutex_lock(&cacheLock);
+
+    // A cached result answers any shorter marathon with its prefix, and any
+    // longer one if it already has all the movies there are.
+    if(data->cache != NULL && ((size_t) k <= data->cacheLength ||
+                               data->cache->size < data->cacheLength)) {
+
+        ++cacheHits;
+
+        sarray_t *cachedMovieList = sarray_copy_prefix(data->cache, (size_t) k);
+
+        pthread_mutex_unlock(&cacheLock);
+
+        return cachedMovieList;
     }
 
-    dnode_t *iter;
+    ++cacheMisses;
+
+    pthread_mutex_unlock(&cacheLock);
+
+    sarray_t *resultMovieList = sarray_make();
+    marathon_top_t *top = &contexts[worker].top;
 
-    while((iter = dlist_get_back((*user)->children)) != NULL) {
+    marathon_tree_calculate_marathon_list(user, (size_t) k, worker, split);
 
-        marathon_tree_destroy((tree_t **) &iter->elem.ptr);
+    // A single sort of the best movies gives the descending order.
+    size_t resultLength = top->heap->size;
 
-        dlist_pop_back((*user)->children);
+    heap_sort(top->heap);
+
+    // Empty the set for the next call, which costs O(k) instead of
+    // the O(capacity) of a full clear.
+    for(size_t i = 0; i < resultLength; ++i) {
+
+        sarray_push_back(resultMovieList, (int) top->heap->data[i].key);
+        hash_set_remove(top->movies, top->heap->data[i].key);
     }
 
-    marathon_tree_destroy_vertex(user);
+    sarray_t *cachedMovieList = sarray_copy_prefix(resultMovieList,
+                                                   resultLength);
+
+    pthread_mutex_lock(&cacheLock);
+
+    if(data->cache == NULL) {
+        ++cachedUsers;
+    }
+    else {
+        sarray_destroy(&data->cache);
+    }
+
+    data->cache = cachedMovieList;
+    data->cacheLength = (size_t) k;
+
+    pthread_mutex_unlock(&cacheLock);
+
+    return resultMovieList;
+}
+
+static void marathon_tree_calculate_marathon_list(unsigned int user,
+                                                  size_t k,
+                                                  unsigned int worker,
+                                                  bool split) {
+
+    for(unsigned int i = 0; i < threadCount; ++i) {
+
+        if(split || i == worker) {
+            contexts[i].top.length = k;
+        }
+    }
+
+    marathon_context_t *context = &contexts[worker];
+
+    if(!layoutValid) {
+
+        marathon_tree_walk(context, user);
+
+        return;
+    }
+
+    unsigned int root = positions[user];
+    unsigned int end = layout[root].end;
+
+    if(!split || end - root <= MARATHON_TASK_SIZE) {
+
+        marathon_tree_scan(context, root, root, end);
+
+        return;
+    }
+
+    // The range is large, its parts are shared between the workers.
+    for(unsigned int start = root; start < end; start += MARATHON_TASK_SIZE) {
+
+        marathon_task_t *task = malloc(sizeof(marathon_task_t));
+
+        // Assure that malloc has not failed.
+        NNULL(task, "marathon_tree_calculate_marathon_list");
+
+        task->root = root;
+        task->start = start;
+        task->end = end - start > MARATHON_TASK_SIZE
+                    ? start + MARATHON_TASK_SIZE
+                    : end;
+
+        thread_pool_submit(pool, 0, marathon_tree_run_task, task);
+    }
+
+    thread_pool_run(pool);
+
+    // Merge the best movies of the other workers and empty them
+    // for the next call.
+    for(unsigned int i = 1; i < threadCount; ++i) {
+
+        marathon_top_t *workerTop = &contexts[i].top;
+
+        for(size_t j = 0; j < workerTop->heap->size; ++j) {
+
+            long movie = workerTop->heap->data[j].key;
+
+            marathon_tree_offer_movie(&context->top, movie);
+            hash_set_remove(workerTop->movies, movie);
+        }
+
+        heap_clear(workerTop->heap);
+    }
+}
+
+static void marathon_tree_scan(marathon_context_t *context, unsigned int root,
+                               unsigned int start, unsigned int end) {
+
+    marathon_top_t *top = &context->top;
+    marathon_stack_t *stack = &context->stack;
+
+    stack->size = 0;
+
+    // A part cut out of the middle of the range starts below some
+    // of the ancestors.
+    if(start > root) {
+        marathon_tree_enter_range(stack, root, start, end);
+    }
+
+    unsigned int position = start;
+
+    while(position < end) {
+
+        // Leave the ranges of the ancestors which have ended.
+        while(stack->size > 0 &&
+              stack->entries[stack->size - 1].end <= position) {
+
+            --stack->size;
+        }
+
+        const marathon_position_t *entry = &layout[position];
+
+        if(entry->user == MARATHON_NONE) {
+
+            ++position;
+
+            continue;
+        }
+
+        // Initial supremum can be -1 because all movie rating's are >= 0.
+        long supremum = stack->size > 0
+                        ? stack->entries[stack->size - 1].supremum
+                        : -1;
+
+        // Only movies above the supremum are considered in the subtree,
+        // and movies not above the smallest best one cannot replace it.
+        if(entry->subtreeMax <= supremum ||
+           (top->heap->size == top->length &&
+            entry->subtreeMax <= heap_top(top->heap).key)) {
+
+            position = entry->end;
+
+            continue;
+        }
+
+        // Update the best movies with values from this user's movie list.
+        marathon_tree_add_movies_to_marathon_list(entry->user, top, supremum);
+
+        // Get the new supremum for the descendants.
+        if(entry->end > position + 1) {
+
+            long newSupremum = marathon_tree_get_max(entry->user);
+
+            if(supremum > newSupremum) {
+                newSupremum = supremum;
+            }
+
+            marathon_tree_push_ancestor(stack, entry->end, newSupremum);
+        }
+
+        ++position;
+    }
+}
+
+static void marathon_tree_walk(marathon_context_t *context, unsigned int user) {
+
+    marathon_top_t *top = &context->top;
+    marathon_stack_t *stack = &context->stack;
+
+    stack->size = 0;
+
+    unsigned int root = user;
+    long supremum = -1;
+
+    while(true) {
+
+        ++context->visited;
+
+        long subtreeMax = marathon_tree_get_subtree_max(user);
+
+        if(subtreeMax > supremum &&
+           (top->heap->size < top->length ||
+            subtreeMax > heap_top(top->heap).key)) {
+
+            marathon_tree_add_movies_to_marathon_list(user, top, supremum);
+
+            if(firstChildren[user] != MARATHON_NONE) {
+
+                marathon_tree_push_ancestor(stack, user, supremum);
+
+                if(marathon_tree_get_max(user) > supremum) {
+                    supremum = marathon_tree_get_max(user);
+                }
+
+                user = firstChildren[user];
+
+                continue;
+            }
+        }
+
+        // Go to the next sibling of the closest ancestor that has one.
+        while(user != root && nextSiblings[user] == MARATHON_NONE) {
+
+            user = marathon_tree_parent(user);
+            supremum = stack->entries[--stack->size].supremum;
+        }
+
+        if(user == root) {
+            return;
+        }
+
+        user = nextSiblings[user];
+    }
+}
+
+static void marathon_tree_enter_range(marathon_stack_t *stack,
+                                      unsigned int root, unsigned int start,
+                                      unsigned int end) {
+
+    while(start < end && layout[start].user == MARATHON_NONE) {
+        ++start;
+    }
+
+    if(start == end) {
+        return;
+    }
+
+    // Push the ancestors from the closest one, with their own maxima.
+    for(unsigned int user = marathon_tree_parent(layout[start].user); ;
+        user = marathon_tree_parent(user)) {
+
+        marathon_tree_push_ancestor(stack, layout[positions[user]].end,
+                                    marathon_tree_get_max(user));
+
+        if(user == layout[root].user) {
+            break;
+        }
+    }
+
+    // Reverse them and let every one inherit the supremum of the farther.
+    for(size_t i = 0; i < stack->size / 2; ++i) {
+
+        marathon_ancestor_t swapped = stack->entries[i];
+
+        stack->entries[i] = stack->entries[stack->size - 1 - i];
+        stack->entries[stack->size - 1 - i] = swapped;
+    }
+
+    for(size_t i = 1; i < stack->size; ++i) {
+
+        if(stack->entries[i - 1].supremum > stack->entries[i].supremum) {
+            stack->entries[i].supremum = stack->entries[i - 1].supremum;
+        }
+    }
+}
+
+static void marathon_tree_push_ancestor(marathon_stack_t *stack,
+                                        unsigned int end, long supremum) {
+
+    if(stack->size == stack->capacity) {
+
+        stack->capacity = stack->capacity == 0 ? 16 : 2 * stack->capacity;
+        stack->entries = realloc(stack->entries, stack->capacity *
+                                                 sizeof(marathon_ancestor_t));
+
+        // Assure that realloc has not failed.
+        NNULL(stack->entries, "marathon_tree_push_ancestor");
+    }
+
+    stack->entries[stack->size].end = end;
+    stack->entries[stack->size].supremum = supremum;
+
+    ++stack->size;
+}
+
+static void marathon_tree_prepare_layout() {
+
+    // Both the scans and the walks skip subtrees by their maxima.
+    marathon_tree_raise_ancestors();
+
+    if(layoutValid) {
+        return;
+    }
+
+    for(unsigned int i = 0; i < threadCount; ++i) {
+
+        layoutDebt += contexts[i].visited;
+        contexts[i].visited = 0;
+    }
+
+    if(layoutDebt < slots->size) {
+        return;
+    }
+
+    layoutDebt = 0;
+
+    unsigned int size = 0;
+    unsigned int user = MARATHON_ROOT;
+
+    while(user != MARATHON_NONE) {
+
+        positions[user] = size;
+        layout[size].user = user;
+        layout[size].subtreeMax = marathon_tree_get_subtree_max(user);
+        ++size;
+
+        if(firstChildren[user] != MARATHON_NONE) {
+
+            user = firstChildren[user];
+
+            continue;
+        }
+
+        // Close the subtrees ending here, up to the closest ancestor
+        // with a next sibling.
+        while(true) {
+
+            layout[positions[user]].end = size;
+
+            if(user == MARATHON_ROOT) {
+
+                user = MARATHON_NONE;
+
+                break;
+            }
+
+            if(nextSiblings[user] != MARATHON_NONE) {
+
+                user = nextSiblings[user];
+
+                break;
+            }
+
+            // The layout is built before the marathons start, so the links
+            // can be shortened for the walks too.
+            user = marathon_tree_compress_parent(user);
+        }
+    }
+
+    layoutValid = true;
+}
+
+static void marathon_tree_run_query(void *arg, unsigned int worker) {
+
+    marathon_query_t *query = arg;
+
+    query->result = marathon_tree_marathon_list(query->userID, query->k,
+                                                worker, false);
+}
+
+static void marathon_tree_run_task(void *arg, unsigned int worker) {
+
+    marathon_task_t task = *(marathon_task_t *) arg;
+
+    free(arg);
+
+    marathon_tree_scan(&contexts[worker], task.root, task.start, task.end);
+}
+
+// Adds the elements from the user's movie list to the best movies.
+// Ignores elements not greater than the threshold. While there are less
+// than length best movies each new one is added, afterwards it replaces
+// the smallest of them if it is bigger.
+static void
+marathon_tree_add_movies_to_marathon_list(unsigned int user,
+                                          marathon_top_t *top, long threshold) {
+
+    for(movie_set_block_t block = movie_set_first_block(&users[user].movies);
+        block.size > 0; block = movie_set_next_block(block)) {
+
+        // Most users have nothing above the threshold, which the highest
+        // rating tells without counting.
+        if(block.data[0] <= threshold) {
+            return;
+        }
+
+        // Only the prefix of movies bigger than the threshold is considered.
+        size_t count = movie_set_count_greater(block, threshold);
+
+        for(size_t i = 0; i < count; ++i) {
+
+            // Movies are sorted, so none of the remaining ones can make it.
+            if(!marathon_tree_offer_movie(top, block.data[i])) {
+                return;
+            }
+        }
+
+        // The rest of the blocks are not bigger than the threshold either.
+        if(count < block.size) {
+            return;
+        }
+    }
+}
+
+static bool marathon_tree_offer_movie(marathon_top_t *top, long movie) {
+
+    bool full = top->heap->size == top->length;
+
+    if(full && movie <= heap_top(top->heap).key) {
+        return false;
+    }
+
+    if(!hash_set_insert(top->movies, movie)) {
+        return true;
+    }
+
+    if(full) {
+
+        hash_set_remove(top->movies, heap_top(top->heap).key);
+        heap_replace_top(top->heap, heap_make_elem(movie, 0));
+    }
+    else {
+        heap_push(top->heap, heap_make_elem(movie, 0));
+    }
+
+    return true;
+}
+
+static long marathon_tree_get_max(unsigned int user) {
+
+    return movie_set_max(&users[user].movies);
+}
+
+static long marathon_tree_get_subtree_max(unsigned int user) {
+
+    return users[user].subtreeMax;
+}
+
+static void marathon_tree_set_subtree_max(unsigned int user, long subtreeMax) {
+
+    marathon_tree_retire(user, MARATHON_PART_MAX);
+
+    users[user].subtreeMax = subtreeMax;
+
+    if(layoutValid) {
+        layout[positions[user]].subtreeMax = subtreeMax;
+    }
+}
+
+static void marathon_tree_update_subtree_max(unsigned int user) {
+
+    while(user != MARATHON_NONE) {
+
+        long subtreeMax = marathon_tree_get_max(user);
+
+        for(unsigned int child = firstChildren[user]; child != MARATHON_NONE;
+            child = nextSiblings[child]) {
+
+            long childMax = marathon_tree_get_subtree_max(child);
+
+            if(childMax > subtreeMax) {
+                subtreeMax = childMax;
+            }
+        }
+
+        if(marathon_tree_get_subtree_max(user) == subtreeMax) {
+            return;
+        }
+
+        marathon_tree_set_subtree_max(user, subtreeMax);
+
+        user = marathon_tree_compress_parent(user);
+    }
+}
+
+static void marathon_tree_raise_subtree_max(unsigned int user, long rating) {
+
+    if(marathon_tree_get_subtree_max(user) >= rating) {
+        return;
+    }
+
+    marathon_tree_set_subtree_max(user, rating);
+
+    // The root has no ancestors to raise.
+    if(user != MARATHON_ROOT && !users[user].raised) {
+
+        users[user].raised = true;
+        raisedUsers[raisedCount++] = user;
+    }
+}
+
+static void marathon_tree_raise_ancestors() {
+
+    if(raisedCount == 0) {
+        return;
+    }
+
+    // Once an ancestor is raised by a higher maximum, the lower ones
+    // stop at him.
+    qsort(raisedUsers, raisedCount, sizeof(unsigned int),
+          marathon_tree_compare_raised);
+
+    for(unsigned int i = 0; i < raisedCount; ++i) {
+
+        unsigned int user = raisedUsers[i];
+        long subtreeMax = marathon_tree_get_subtree_max(user);
+
+        users[user].raised = false;
+        user = marathon_tree_compress_parent(user);
+
+        while(user != MARATHON_NONE &&
+              marathon_tree_get_subtree_max(user) < subtreeMax) {
+
+            marathon_tree_set_subtree_max(user, subtreeMax);
+
+            user = marathon_tree_compress_parent(user);
+        }
+    }
+
+    raisedCount = 0;
+}
+
+static int marathon_tree_compare_raised(const void *first,
+                                        const void *second) {
+
+    long a = users[*(const unsigned int *) first].subtreeMax;
+    long b = users[*(const unsigned int *) second].subtreeMax;
+
+    return a > b ? -1 : (a < b);
+}
+
+static unsigned int marathon_tree_next_preorder(unsigned int user) {
+
+    unsigned int next = firstChildren[user];
+
+    // Without children go to the next sibling of the closest ancestor
+    // that has one.
+    while(next == MARATHON_NONE && user != MARATHON_ROOT) {
+
+        next = nextSiblings[user];
+        user = marathon_tree_parent(user);
+    }
+
+    return next;
+}
+
+static bool marathon_tree_check_snapshot(const char *snapshot, size_t size) {
+
+    marathon_snapshot_header_t header;
+
+    memcpy(&header, snapshot, sizeof(header));
+
+    size_t entriesSize = size - sizeof(header);
+
+    if(memcmp(header.magic, MARATHON_SNAPSHOT_MAGIC,
+              sizeof(header.magic)) != 0 ||
+       header.userCount == 0 ||
+       entriesSize < header.userCount * sizeof(marathon_snapshot_user_t) ||
+       (entriesSize - header.userCount * sizeof(marathon_snapshot_user_t)) /
+       sizeof(int32_t) != header.movieCount ||
+       (entriesSize - header.userCount * sizeof(marathon_snapshot_user_t)) %
+       sizeof(int32_t) != 0) {
+
+        return false;
+    }
+
+    const char *entries = snapshot + sizeof(header);
+    const char *movies = entries +
+                         header.userCount * sizeof(marathon_snapshot_user_t);
+
+    hash_set_t *present = hash_set_make();
+
+    bool correct = true;
+
+    for(uint32_t i = 0; correct && i < header.userCount; ++i) {
+
+        marathon_snapshot_user_t entry;
+
+        memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+
+        // The root goes first, everyone else after the parent.
+        if(i == 0) {
+            correct = entry.userID == 0;
+        }
+        else {
+            correct = entry.userID <= MAX_USER &&
+                      !hash_set_contains(present, entry.userID) &&
+                      hash_set_contains(present, entry.parentID);
+        }
+
+        correct = correct && entry.movieOffset <= header.movieCount &&
+                  entry.movieCount <= header.movieCount - entry.movieOffset;
+
+        int32_t previous = 0;
+
+        // Movies have to be distinct, correct and in descending order.
+        for(uint32_t j = 0; correct && j < entry.movieCount; ++j) {
+
+            int32_t movie;
+
+            memcpy(&movie, movies + (entry.movieOffset + j) * sizeof(movie),
+                   sizeof(movie));
+
+            correct = movie >= 0 && movie <= MAX_MOVIE &&
+                      (j == 0 || movie < previous);
+
+            previous = movie;
+        }
+
+        if(correct) {
+            hash_set_insert(present, entry.userID);
+        }
+    }
+
+    hash_set_destroy(&present);
+
+    return correct;
+}
+
+static void marathon_tree_build_snapshot(const char *snapshot) {
+
+    marathon_snapshot_header_t header;
+
+    memcpy(&header, snapshot, sizeof(header));
+
+    const char *entries = snapshot + sizeof(header);
+    const char *movies = entries +
+                         header.userCount * sizeof(marathon_snapshot_user_t);
+
+    marathon_tree_destroy_users();
+
+    layoutValid = false;
+
+    // Slots are given out from zero again, so the i-th user gets slot i
+    // and the users are laid out in preorder.
+    if(header.userCount > slotCapacity) {
+        marathon_tree_reserve(header.userCount);
+    }
+
+    for(uint32_t i = 0; i < header.userCount; ++i) {
+
+        marathon_snapshot_user_t entry;
+
+        memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+
+        unsigned int user = marathon_tree_make_user(entry.userID);
+
+        // The movies are checked to be in descending order already and
+        // the mapping is aligned for them, since the header and the entries
+        // are made of whole 32-bit words, so the set is built in place.
+        movie_set_build_sorted(&users[user].movies,
+                               (const int *) (movies + entry.movieOffset *
+                                                       sizeof(int32_t)),
+                               entry.movieCount);
+
+        if(users[user].movies.promoted) {
+            ++promotedSets;
+        }
+
+        if(i > 0) {
+            marathon_tree_link_child(marathon_tree_find(entry.parentID), user);
+        }
+    }
+
+    // Children go after their parents, so going backwards every subtree
+    // maximum is complete before it is passed to the parent.
+    for(unsigned int user = header.userCount; user-- > 0;) {
+
+        marathon_user_t *data = &users[user];
+
+        if(marathon_tree_get_max(user) > data->subtreeMax) {
+            data->subtreeMax = marathon_tree_get_max(user);
+        }
+
+        if(user != MARATHON_ROOT &&
+           data->subtreeMax > users[parents[user]].subtreeMax) {
+
+            users[parents[user]].subtreeMax = data->subtreeMax;
+        }
+    }
+}
+
+static bool marathon_tree_sync_directory(const char *path) {
+
+    const char *slash = strrchr(path, '/');
+    char *directory = slash == NULL
+                      ? strdup(".")
+                      : strndup(path, (size_t) (slash - path) + 1);
+
+    // Assure that strdup has not failed.
+    NNULL(directory, "marathon_tree_sync_directory");
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+
+    free(directory);
+
+    bool synced = fd >= 0 && fsync(fd) == 0;
+
+    if(fd >= 0 && close(fd) != 0) {
+        synced = false;
+    }
+
+    return synced;
+}
+
+static long marathon_tree_apply_batch(unsigned int user, const int *movies,
+                                      size_t count, bool *results,
+                                      bool insert) {
+
+    if(count == 0) {
+        return -1;
+    }
+
+    marathon_batch_entry_t *entries = malloc(count * sizeof(*entries));
+    int *unique = malloc(count * sizeof(int));
+    bool *applied = malloc(count * sizeof(bool));
+
+    // Assure that malloc has not failed.
+    NNULL(entries, "entries/marathon_tree_apply_batch");
+    NNULL(unique, "unique/marathon_tree_apply_batch");
+    NNULL(applied, "applied/marathon_tree_apply_batch");
+
+    for(size_t i = 0; i < count; ++i) {
+
+        entries[i].movie = movies[i];
+        entries[i].position = i;
+    }
+
+    qsort(entries, count, sizeof(*entries),
+          marathon_tree_compare_batch_entries);
+
+    size_t uniqueCount = 0;
+
+    // Only the first of the repeated ratings can change the set, the
+    // entries of the unique ones are moved to the front.
+    for(size_t i = 0; i < count; ++i) {
+
+        if(uniqueCount > 0 && unique[uniqueCount - 1] == entries[i].movie) {
+
+            results[entries[i].position] = false;
+
+            continue;
+        }
+
+        unique[uniqueCount] = entries[i].movie;
+        entries[uniqueCount].position = entries[i].position;
+        ++uniqueCount;
+    }
+
+    movie_set_t *set = &users[user].movies;
+
+    bool promoted = set->promoted;
+
+    if(insert) {
+        movie_set_insert_sorted(set, unique, uniqueCount, applied);
+    }
+    else {
+        movie_set_remove_sorted(set, unique, uniqueCount, applied);
+    }
+
+    if(set->promoted && !promoted) {
+        ++promotedSets;
+    }
+
+    if(promoted && !set->promoted) {
+        --promotedSets;
+    }
+
+    long maxApplied = -1;
+    size_t appliedCount = 0;
+
+    // The applied ratings are moved to the front, in the same order.
+    for(size_t i = 0; i < uniqueCount; ++i) {
+
+        results[entries[i].position] = applied[i];
+
+        if(applied[i]) {
+            unique[appliedCount++] = unique[i];
+        }
+    }
+
+    if(appliedCount > 0) {
+        maxApplied = unique[0];
+    }
+
+    // The set may have been rebuilt even if nothing was applied, the cursors
+    // have to find their positions in it again.
+    marathon_tree_retire_movies(user, unique, appliedCount, insert);
+
+    free(entries);
+    free(unique);
+    free(applied);
+
+    return maxApplied;
+}
+
+static void marathon_tree_cursor_push_user(marathon_cursor_t *cursor,
+                                           unsigned int user, long supremum) {
+
+    marathon_retired_t *state = marathon_tree_retired_state(
+            user, MARATHON_PART_MAX, cursor->version);
+    long subtreeMax = state != NULL ? state->subtreeMax
+                                    : marathon_tree_get_subtree_max(user);
+
+    if(subtreeMax <= supremum) {
+        return;
+    }
+
+    if(cursor->sourceCount == cursor->sourceCapacity) {
+
+        cursor->sourceCapacity = cursor->sourceCapacity == 0 ?
+                                 16 : 2 * cursor->sourceCapacity;
+        cursor->sources = realloc(cursor->sources, cursor->sourceCapacity *
+                                                   sizeof(marathon_source_t));
+
+        // Assure that realloc has not failed.
+        NNULL(cursor->sources, "marathon_tree_cursor_push_user");
+    }
+
+    marathon_source_t *source = &cursor->sources[cursor->sourceCount];
+
+    source->user = user;
+    source->expanded = false;
+    source->supremum = supremum;
+    source->delta = NULL;
+
+    heap_push(cursor->heap, heap_make_elem(-subtreeMax,
+                                           (long) cursor->sourceCount));
+
+    ++cursor->sourceCount;
+}
+
+static void marathon_tree_cursor_expand(marathon_cursor_t *cursor,
+                                        size_t source) {
+
+    marathon_source_t *data = &cursor->sources[source];
+    unsigned int user = data->user;
+    long supremum = data->supremum;
+
+    data->expanded = true;
+    data->movie = LONG_MAX;
+    data->synced = cursor->version;
+    data->delta = NULL;
+
+    marathon_tree_cursor_sync(data);
+
+    // The first movie is the highest one the user had at the version.
+    long first = marathon_tree_cursor_advance(data);
+
+    if(first > supremum) {
+        heap_push(cursor->heap, heap_make_elem(-first, (long) source));
+    }
+
+    // The children only count with movies above all of their ancestors'.
+    long childSupremum = first;
+
+    if(childSupremum < supremum) {
+        childSupremum = supremum;
+    }
+
+    // Pushing the children may move the sources, data is not used below.
+    marathon_retired_t *state = marathon_tree_retired_state(
+            user, MARATHON_PART_CHILDREN, cursor->version);
+
+    if(state != NULL) {
+
+        for(unsigned int i = 0; i < state->childCount; ++i) {
+            marathon_tree_cursor_push_user(cursor, state->children[i],
+                                           childSupremum);
+        }
+
+        return;
+    }
+
+    for(unsigned int child = firstChildren[user]; child != MARATHON_NONE;
+        child = nextSiblings[child]) {
+
+        marathon_tree_cursor_push_user(cursor, child, childSupremum);
+    }
+}
+
+static long marathon_tree_cursor_advance(marathon_source_t *source) {
+
+    marathon_history_t *history = users[source->user].history;
+
+    if(history != NULL &&
+       history->since[MARATHON_PART_MOVIES] > source->synced) {
+
+        marathon_tree_cursor_sync(source);
+    }
+
+    marathon_delta_t *delta = source->delta;
+    long movie = -1;
+
+    // The changed movies are only taken from the delta.
+    while(source->block.size > 0) {
+
+        int current = (int) marathon_tree_cursor_movie(source);
+
+        if(delta == NULL || (!movie_set_contains(&delta->present, current) &&
+                             !movie_set_contains(&delta->absent, current))) {
+
+            movie = current;
+
+            break;
+        }
+
+        if(++source->position == source->block.size) {
+
+            source->block = movie_set_next_block(source->block);
+            source->position = 0;
+        }
+    }
+
+    if(delta != NULL && delta->next > movie) {
+
+        movie = delta->next;
+
+        size_t position;
+        movie_set_block_t block = movie_set_seek(&delta->present, movie,
+                                                 &position);
+
+        delta->next = block.size > 0 ? block.data[position] : -1;
+    }
+    else if(movie >= 0 && ++source->position == source->block.size) {
+
+        source->block = movie_set_next_block(source->block);
+        source->position = 0;
+    }
+
+    source->movie = movie;
+
+    return movie;
+}
+
+static long marathon_tree_cursor_movie(const marathon_source_t *source) {
+
+    const int *movies = source->block.leaf != NULL ? source->block.data
+                                                   : source->movies;
+
+    return movies[source->position];
+}
+
+static void marathon_tree_cursor_sync(marathon_source_t *source) {
+
+    unsigned int user = source->user;
+    marathon_retired_t *state = marathon_tree_retired_state(
+            user, MARATHON_PART_MOVIES, source->synced);
+
+    // The oldest change of a movie decides whether the cursor has it.
+    for(; state != NULL; state = state->newer) {
+
+        marathon_tree_cursor_gather(source, state);
+
+        source->synced = state->until;
+    }
+
+    source->block = movie_set_seek(&users[user].movies, source->movie,
+                                   &source->position);
+
+    if(source->block.leaf == NULL && source->block.size > 0) {
+        memcpy(source->movies, source->block.data,
+               source->block.size * sizeof(int));
+    }
+}
+
+static void marathon_tree_cursor_gather(marathon_source_t *source,
+                                        const marathon_retired_t *state) {
+
+    marathon_delta_t *delta = source->delta;
+    size_t position;
+
+    for(movie_set_block_t block = movie_set_seek(&state->movies,
+                                                 source->movie, &position);
+        block.size > 0; block = movie_set_next_block(block), position = 0) {
+
+        for(; position < block.size; ++position) {
+
+            int movie = block.data[position];
+
+            if(delta == NULL) {
+
+                delta = malloc(sizeof(marathon_delta_t));
+
+                // Assure that malloc has not failed.
+                NNULL(delta, "marathon_tree_cursor_gather");
+
+                movie_set_init(&delta->present);
+                movie_set_init(&delta->absent);
+                delta->next = -1;
+
+                source->delta = delta;
+            }
+            else if(movie_set_contains(&delta->present, movie) ||
+                    movie_set_contains(&delta->absent, movie)) {
+
+                continue;
+            }
+
+            // An inserted movie was missing before, a removed one was there.
+            if(state->inserted) {
+                movie_set_insert(&delta->absent, movie);
+            }
+            else {
+
+                movie_set_insert(&delta->present, movie);
+
+                if(delta->next < movie) {
+                    delta->next = movie;
+                }
+            }
+        }
+    }
+}
+
+static void marathon_tree_release_deltas(marathon_cursor_t *cursor) {
+
+    for(size_t i = 0; i < cursor->sourceCount; ++i) {
+
+        marathon_delta_t *delta = cursor->sources[i].delta;
+
+        if(delta == NULL) {
+            continue;
+        }
+
+        movie_set_clear(&delta->present);
+        movie_set_clear(&delta->absent);
+        free(delta);
+
+        cursor->sources[i].delta = NULL;
+    }
+}
+
+static marathon_retired_t *marathon_tree_retired_state(unsigned int user,
+                                                       marathon_part_t part,
+                                                       unsigned long version) {
+
+    marathon_history_t *history = users[user].history;
+
+    if(history == NULL || history->since[part] <= version) {
+        return NULL;
+    }
+
+    // The oldest state retired after the version.
+    marathon_retired_t *state = history->retired[part];
+
+    while(state->older != NULL && state->older->until > version) {
+        state = state->older;
+    }
+
+    return state;
+}
+
+static marathon_retired_t *marathon_tree_retire(unsigned int user,
+                                                marathon_part_t part) {
+
+    dnode_t *newest = dlist_get_back(&openCursors);
+    marathon_history_t *history = users[user].history;
+
+    // The current state has been retired after the newest cursor was
+    // opened already, or there are no cursors at all. Every change
+    // of the movies is needed to correct the current set.
+    if(newest == NULL || (part != MARATHON_PART_MOVIES && history != NULL &&
+                          history->since[part] >
+                          DLIST_ENTRY(newest, marathon_cursor_t,
+                                      link)->version)) {
+
+        return NULL;
+    }
+
+    marathon_retired_t *state = marathon_tree_make_retired(user, part);
+
+    switch(part) {
+
+        case MARATHON_PART_MOVIES:
+            movie_set_init(&state->movies);
+            break;
+
+        case MARATHON_PART_MAX:
+            state->subtreeMax = users[user].subtreeMax;
+            break;
+
+        case MARATHON_PART_CHILDREN:
+            state->childCount = 0;
+
+            for(unsigned int child = firstChildren[user];
+                child != MARATHON_NONE; child = nextSiblings[child]) {
+
+                ++state->childCount;
+            }
+
+            state->children = NULL;
+
+            if(state->childCount > 0) {
+
+                state->children = malloc(state->childCount *
+                                         sizeof(unsigned int));
+
+                // Assure that malloc has not failed.
+                NNULL(state->children, "marathon_tree_retire");
+            }
+
+            state->childCount = 0;
+
+            for(unsigned int child = firstChildren[user];
+                child != MARATHON_NONE; child = nextSiblings[child]) {
+
+                state->children[state->childCount++] = child;
+            }
+
+            break;
+
+        case MARATHON_PART_SLOT:
+            break;
+    }
+
+    if(history == NULL) {
+
+        history = arena_alloc(historyArena);
+
+        for(int i = 0; i < MARATHON_PART_SLOT; ++i) {
+
+            history->retired[i] = NULL;
+            history->since[i] = 0;
+        }
+
+        history->count = 0;
+        users[user].history = history;
+    }
+
+    state->older = history->retired[part];
+
+    if(state->older != NULL) {
+        state->older->newer = state;
+    }
+
+    history->retired[part] = state;
+    history->since[part] = state->until;
+    ++history->count;
+
+    return state;
+}
+
+static void marathon_tree_retire_movies(unsigned int user, const int *movies,
+                                        size_t count, bool inserted) {
+
+    marathon_retired_t *state = marathon_tree_retire(user,
+                                                     MARATHON_PART_MOVIES);
+
+    if(state != NULL) {
+
+        movie_set_build_sorted(&state->movies, movies, count);
+        state->inserted = inserted;
+    }
+}
+
+static marathon_retired_t *marathon_tree_make_retired(unsigned int user,
+                                                      marathon_part_t part) {
+
+    marathon_retired_t *state = arena_alloc(retiredArena);
+
+    state->user = user;
+    state->part = part;
+    state->until = treeVersion;
+    state->older = NULL;
+    state->newer = NULL;
+
+    dlist_push_back(&retiredStates, &state->link);
+
+    return state;
+}
+
+static void marathon_tree_reclaim() {
+
+    dnode_t *oldest = dlist_get_front(&openCursors);
+    dnode_t *node;
+
+    while((node = dlist_get_front(&retiredStates)) != NULL) {
+
+        marathon_retired_t *state = DLIST_ENTRY(node, marathon_retired_t,
+                                                link);
+
+        // Still valid for the oldest cursor, and so are all the later ones.
+        if(oldest != NULL && state->until >
+                             DLIST_ENTRY(oldest, marathon_cursor_t,
+                                         link)->version) {
+
+            return;
+        }
+
+        dlist_remove(node);
+
+        marathon_tree_release_retired(state);
+    }
+}
+
+static void marathon_tree_release_retired(marathon_retired_t *state) {
+
+    unsigned int user = state->user;
+    marathon_history_t *history = users[user].history;
+
+    switch(state->part) {
+
+        case MARATHON_PART_MOVIES:
+            movie_set_clear(&state->movies);
+            break;
+
+        case MARATHON_PART_MAX:
+            break;
+
+        case MARATHON_PART_CHILDREN:
+            free(state->children);
+            break;
+
+        // All the states of the user were retired before his slot.
+        case MARATHON_PART_SLOT:
+            arena_free(retiredArena, state);
+            marathon_tree_drop_link(user);
+
+            return;
+    }
+
+    if(state->newer != NULL) {
+        state->newer->older = NULL;
+    }
+    else {
+        history->retired[state->part] = NULL;
+    }
+
+    arena_free(retiredArena, state);
+
+    if(--history->count == 0) {
+
+        arena_free(historyArena, history);
+        users[user].history = NULL;
+    }
+}
+
+static int marathon_tree_compare_batch_entries(const void *first,
+                                               const void *second) {
+
+    const marathon_batch_entry_t *a = first;
+    const marathon_batch_entry_t *b = second;
+
+    if(a->movie != b->movie) {
+        return a->movie > b->movie ? -1 : 1;
+    }
+
+    return a->position < b->position ? -1 : (a->position > b->position);
+}
+
+static void marathon_tree_invalidate_cache(unsigned int user) {
+
+    // Stop as soon as there are no cached results left anywhere.
+    while(user != MARATHON_NONE && cachedUsers > 0) {
+
+        marathon_tree_drop_cache(&users[user]);
+
+        user = marathon_tree_compress_parent(user);
+    }
+}
+
+static void marathon_tree_drop_cache(marathon_user_t *data) {
+
+    if(data->cache != NULL) {
+
+        sarray_destroy(&data->cache);
+
+        --cachedUsers;
+    }
+}
+
+static unsigned int marathon_tree_make_user(unsigned int userID) {
+
+    unsigned int user = freeSlots;
+
+    if(user != MARATHON_NONE) {
+        freeSlots = nextSiblings[user];
+    }
+    else {
+
+        // There are never more slots than identifiers.
+        if(slotCount == slotCapacity) {
+            marathon_tree_reserve(slotCapacity > MAX_USER / 2
+                                  ? MAX_USER + 1
+                                  : 2 * slotCapacity);
+        }
+
+        user = slotCount++;
+    }
+
+    hash_map_insert(slots, userID, user);
+
+    marathon_user_t *data = &users[user];
+
+    movie_set_init(&data->movies);
+    data->subtreeMax = -1;
+    data->raised = false;
+    data->cache = NULL;
+    data->cacheLength = 0;
+    data->history = NULL;
+    data->links = 0;
+
+    userIDs[user] = userID;
+    parents[user] = MARATHON_NONE;
+    firstChildren[user] = MARATHON_NONE;
+    lastChildren[user] = MARATHON_NONE;
+    nextSiblings[user] = MARATHON_NONE;
+    prevSiblings[user] = MARATHON_NONE;
+
+    return user;
+}
+
+static void marathon_tree_link_child(unsigned int parent, unsigned int user) {
+
+    unsigned int last = lastChildren[parent];
+
+    parents[user] = parent;
+    prevSiblings[user] = last;
+
+    ++users[parent].links;
+
+    if(last == MARATHON_NONE) {
+        firstChildren[parent] = user;
+    }
+    else {
+        nextSiblings[last] = user;
+    }
+
+    lastChildren[parent] = user;
+}
+
+static unsigned int marathon_tree_find(unsigned int userID) {
+
+    return hash_map_get(slots, userID);
+}
+
+static unsigned int marathon_tree_parent(unsigned int user) {
+
+    unsigned int parent = parents[user];
+
+    // Removed users are never the root, so they always have a parent.
+    while(parent != MARATHON_NONE && userIDs[parent] == MARATHON_NONE) {
+        parent = parents[parent];
+    }
+
+    return parent;
+}
+
+static unsigned int marathon_tree_compress_parent(unsigned int user) {
+
+    unsigned int parent = marathon_tree_parent(user);
+    unsigned int link = parents[user];
+
+    while(link != parent) {
+
+        unsigned int next = parents[link];
+        bool released = users[link].links == 1;
+
+        parents[user] = parent;
+        ++users[parent].links;
+
+        marathon_tree_drop_link(link);
+
+        // The rest of the way is released with the link or compressed
+        // from it.
+        if(released) {
+            break;
+        }
+
+        user = link;
+        link = next;
+    }
+
+    return parent;
+}
+
+static void marathon_tree_drop_link(unsigned int user) {
+
+    if(--users[user].links == 0 && userIDs[user] == MARATHON_NONE) {
+        marathon_tree_release_user(user);
+    }
+}
+
+static void marathon_tree_destroy_user(unsigned int user) {
+
+    marathon_user_t *data = &users[user];
+
+    marathon_tree_drop_cache(data);
+
+    if(data->movies.promoted) {
+        --promotedSets;
+    }
+
+    hash_map_remove(slots, userIDs[user]);
+    userIDs[user] = MARATHON_NONE;
+
+    // The open cursors may still reach the user through the retired
+    // children of his parent, they hold a link until they cannot.
+    if(dlist_is_empty(&openCursors)) {
+        movie_set_clear(&data->movies);
+    }
+    else {
+
+        ++data->links;
+
+        marathon_tree_make_retired(user, MARATHON_PART_SLOT);
+    }
+
+    if(data->links == 0) {
+        marathon_tree_release_user(user);
+    }
+}
+
+static void marathon_tree_release_user(unsigned int user) {
+
+    // Releasing the user drops his link, which can release his parent
+    // if he has been removed too, and so on up the forwarding links.
+    while(true) {
+
+        unsigned int parent = parents[user];
+
+        movie_set_clear(&users[user].movies);
+
+        nextSiblings[user] = freeSlots;
+        freeSlots = user;
+
+        if(--users[parent].links > 0 || userIDs[parent] != MARATHON_NONE) {
+            return;
+        }
+
+        user = parent;
+    }
+}
+
+static void marathon_tree_destroy_users() {
+
+    // The open cursors become stale, nothing reads the retired states
+    // any more. Their deltas are released before the trees go.
+    while(!dlist_is_empty(&openCursors)) {
+
+        dnode_t *node = dlist_pop_front(&openCursors);
+
+        marathon_tree_release_deltas(DLIST_ENTRY(node, marathon_cursor_t,
+                                                 link));
+    }
+
+    marathon_tree_reclaim();
+
+    // Only the cached results are allocated per user, the rest lives
+    // in the dense arrays and the arenas of the movie trees.
+    for(unsigned int user = 0; cachedUsers > 0 && user < slotCount; ++user) {
+
+        if(userIDs[user] != MARATHON_NONE) {
+            marathon_tree_drop_cache(&users[user]);
+        }
+    }
+
+    btree_release_all();
+    hash_map_clear(slots);
+
+    slotCount = 0;
+    freeSlots = MARATHON_NONE;
+    raisedCount = 0;
+    promotedSets = 0;
+}
+
+static void marathon_tree_reserve(unsigned int capacity) {
+
+    users = realloc(users, capacity * sizeof(marathon_user_t));
+    userIDs = realloc(userIDs, capacity * sizeof(unsigned int));
+    layout = realloc(layout, capacity * sizeof(marathon_position_t));
+    positions = realloc(positions, capacity * sizeof(unsigned int));
+    parents = realloc(parents, capacity * sizeof(unsigned int));
+    firstChildren = realloc(firstChildren, capacity * sizeof(unsigned int));
+    lastChildren = realloc(lastChildren, capacity * sizeof(unsigned int));
+    nextSiblings = realloc(nextSiblings, capacity * sizeof(unsigned int));
+    prevSiblings = realloc(prevSiblings, capacity * sizeof(unsigned int));
+    raisedUsers = realloc(raisedUsers, capacity * sizeof(unsigned int));
+
+    // Assure that realloc has not failed.
+    NNULL(users, "users/marathon_tree_reserve");
+    NNULL(userIDs, "userIDs/marathon_tree_reserve");
+    NNULL(layout, "layout/marathon_tree_reserve");
+    NNULL(positions, "positions/marathon_tree_reserve");
+    NNULL(parents, "parents/marathon_tree_reserve");
+    NNULL(firstChildren, "firstChildren/marathon_tree_reserve");
+    NNULL(lastChildren, "lastChildren/marathon_tree_reserve");
+    NNULL(nextSiblings, "nextSiblings/marathon_tree_reserve");
+    NNULL(prevSiblings, "prevSiblings/marathon_tree_reserve");
+    NNULL(raisedUsers, "raisedUsers/marathon_tree_reserve");
+
+    slotCapacity = capacity;
 }
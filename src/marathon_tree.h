@@ -1,12 +1,52 @@
 /**
- * Extension of the tree structure. Allows all operations specified
- * by the Marathon task. Each user is a node in the tree and contains
- * a list of movies.
- * Adding and deleting a user takes constant time.
- * Adding or deleting a movie takes time proportional to the number of movies
- * currently on the list.
- * Marathon takes O(kn) time and O(k) memory, where n is the number of nodes
- * in the user's subtree and k is the length of the resultant list.
+ * Tree of users allowing all operations specified by the Marathon task.
+ * Every user occupies a slot found through a hash map from his userID,
+ * so memory grows with the number of users rather than the range
+ * of identifiers. The topology is kept in dense arrays indexed by slot:
+ * the parent, the first and last child and the siblings of every user.
+ * Each user has a set of movies, inline for the few ratings most users
+ * have and a B+ tree for the rest, and knows the highest rating in his
+ * subtree. A change raising it only raises the user's own maximum and
+ * puts him on a list of raised users. The ancestors are raised in bulk
+ * by the next operation reading the maxima, the highest raises first,
+ * so every ancestor is raised at most once per batch and no single change
+ * walks the path to the root.
+ * Adding a user takes constant time. Deleting a user splices his children
+ * into the parent's list as they are and leaves the user behind as a link
+ * forwarding them to the parent, which the later updates shorten, so it
+ * takes amortised constant time while the parent's subtree maximum stays.
+ * If his best movie was the best one in the parent's subtree, the maxima
+ * of the children are not kept in any order, so all the parent's children
+ * are visited to find the new maximum, and so are the children of every
+ * ancestor whose maximum drops with it. In the worst case that is linear
+ * in the number of users.
+ * Adding a movie takes time logarithmic in the number of movies currently
+ * in the set. Deleting one takes the same time, plus passing the pending
+ * raises on and, if it was the best one of the user's subtree, finding
+ * the maxima on the path to the root again the same way, until one does
+ * not change.
+ * Batches of movies are sorted and merged into the set.
+ * The users are also laid out in preorder, so every subtree is a contiguous
+ * range. Deleting a user leaves a tombstone in his place, adding one
+ * invalidates the layout, which is rebuilt lazily by the marathons.
+ * Marathon scans the range of the user's subtree sequentially, keeping
+ * the suprema of the ancestors on a small stack, and skips the subtrees
+ * that cannot contribute, so it takes O(n + m log k) time in the worst
+ * case, where n is the number of nodes in the user's subtree, m is the number
+ * of movies considered and k is the length of the resultant list, plus
+ * passing the pending raises on. Without a valid layout it walks the same
+ * subtree following the links.
+ * Marathons over large subtrees are evaluated by a pool of threads, each
+ * scanning parts of the range into its own best movies, which are merged
+ * at the end. Batches of marathons can be answered concurrently by the same
+ * pool.
+ * Marathon results are cached per user, changes of movies or users drop
+ * the cached results on the path to the root.
+ * Cursors read the tree as it was when they were opened. While any is open,
+ * changes retire the maxima and children they replace, changes of movies
+ * record only the movies they added or removed, and removed users keep
+ * their slots; retired states are released in the order they were made,
+ * once no cursor older than them is left.
  *
  * Author: Mateusz Gienieczko
  * Copyright (C) 2018
@@ -15,10 +55,27 @@
 #ifndef IPP_MARATHON_MARATHON_TREE_H
 #define IPP_MARATHON_MARATHON_TREE_H
 
-#include "tree.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include "sorted_array.h"
+
+// A single marathon query and its result, as given
+// by marathon_tree_get_marathon_list.
+typedef struct marathon_query_t {
+
+    unsigned int userID;
+    long k;
+    sarray_t *result;
+
+} marathon_query_t;
+
+// Marathon of a single user read in parts, see marathon_tree_open_cursor.
+typedef struct marathon_cursor_t marathon_cursor_t;
 
 // Create the root user with ID 0 and set up the tree for further use.
-void marathon_tree_initialize();
+// Marathons over large subtrees are split between the given number
+// of threads, including the calling one.
+void marathon_tree_initialize(unsigned int threads);
 
 // Release all the resources allocated and destroy the entire tree.
 void marathon_tree_cleanup();
@@ -30,25 +87,106 @@ bool marathon_tree_add(unsigned int parentID, unsigned int userID);
 
 // Remove the user from the tree.
 // Returns true iff the user was successfully removed.
-// Takes constant time.
+// Takes amortised constant time if the parent's subtree maximum stays.
+// Otherwise it is found again among all the parent's children, also
+// the adopted ones, and so on up while the maxima drop, which is linear
+// in the number of users in the worst case.
 bool marathon_tree_remove(unsigned int userID);
 
 // Add the given movie to the user's movie_list.
 // Returns true iff the movie was successfully added.
-// Time proportional to the number of preferences of the user.
+// Time logarithmic in the number of preferences of the user, the maxima
+// of the ancestors are only raised in bulk before they are read.
 bool marathon_tree_add_movie(unsigned int userID, long movieRating);
 
 // Remove the given movie from the user's movie_list.
 // Returns true iff the movie was successfully removed.
-// Time proportional to the number of preferences of the user.
+// Time logarithmic in the number of preferences of the user, plus passing
+// the pending raises of the maxima on and updating the ones the movie
+// was the best of, each by visiting all the children of its user.
 bool marathon_tree_remove_movie(unsigned int userID, long movieRating);
 
+// Add the count movies to the user's movie list as if they were added
+// one by one, setting added[i] to true iff the i-th one was added.
+// Returns false and does nothing if there is no such user.
+// The batch is sorted once and merged in time linear in the number
+// of preferences of the user, unless it is much smaller than them.
+bool marathon_tree_add_movies(unsigned int userID, const int *movies,
+                              size_t count, bool *added);
+
+// Remove the count movies from the user's movie list as if they were
+// removed one by one, setting removed[i] to true iff the i-th one was.
+// Returns false and does nothing if there is no such user.
+// Takes the same time as marathon_tree_add_movies.
+bool marathon_tree_remove_movies(unsigned int userID, const int *movies,
+                                 size_t count, bool *removed);
+
+// Save the whole tree to the file at the given path, replacing it.
+// The snapshot is a flat array of users in preorder followed by all
+// their movies, written at once to the path with ".tmp" appended,
+// synchronised to the disk and only then renamed over the previous one.
+// Returns true iff the snapshot was written completely and replaced
+// the previous one, which is kept whole otherwise.
+// Takes time linear in the size of the tree.
+bool marathon_tree_save(const char *path);
+
+// Replace the tree with the one saved in the file at the given path.
+// The file is mapped and every movie set is built in bulk from its sorted
+// ratings, with no parsing of commands and no insertions one by one.
+// Returns false and keeps the tree if the file is not a correct snapshot.
+// Takes time linear in the size of the snapshot.
+bool marathon_tree_load(const char *path);
+
 // Gives a list of at most k movies that are chosen from:
 // - All the user's preferences
 // - Results of the marathon function for its children, but only movies that
 //   have higher ratings than all of the original user's ratings are considered.
-// Time proportional to k * size of the tree.
-dlist_t *marathon_tree_get_marathon_list(unsigned int userID, long k);
+// The list is sorted in descending order.
+// Only visits subtrees that can contribute to the result. The last result
+// is cached for every user until a change in his subtree, and answers
+// repeated and shorter marathons in time proportional to k.
+sarray_t *marathon_tree_get_marathon_list(unsigned int userID, long k);
+
+// Answers count marathon queries. With more than one thread the queries
+// are answered concurrently, each of them by a single thread.
+// No other operation can be performed at the same time.
+void marathon_tree_run_queries(marathon_query_t *queries, size_t count);
+
+// Opens a cursor over the marathon of the user, giving the same movies
+// as marathon_tree_get_marathon_list with an unlimited length, a few
+// at a time. Returns NULL if there is no such user.
+// Takes constant time apart from passing the pending raises of the maxima
+// on, all the work is done while reading.
+marathon_cursor_t *marathon_tree_open_cursor(unsigned int userID);
+
+// Gives the next at most n movies of the cursor's marathon, an empty list
+// once they are all read. The marathon is the one the user had when
+// the cursor was opened: changes made since, also removing the user,
+// are not seen. The parts of the tree they replace are kept until no
+// cursor open before them is left. Returns NULL if the tree has been
+// loaded since the cursor was opened, it can only be closed then.
+// The users and their movies are merged lazily: only the subtrees whose
+// best movie could come next are expanded, so the time is proportional
+// to the number of movies given, times the logarithm of the number
+// of sources open, plus the children of the users expanded.
+// The movies are read from the current sets, which are never copied for
+// the cursors. A user's movies changed since the cursor was opened are
+// gathered once per change, and each of his movies read after that costs
+// a logarithmic lookup among them. His position in the set is searched
+// for again in logarithmic time after each change.
+sarray_t *marathon_tree_cursor_next(marathon_cursor_t *cursor, long n);
+
+// Releases the cursor and NULLs the pointer.
+void marathon_tree_close_cursor(marathon_cursor_t **cursor);
+
+// Gives the number of users keeping their movies inline and the number
+// of ones whose movies have been promoted to a tree.
+void marathon_tree_get_set_stats(unsigned long *inlineSets,
+                                 unsigned long *treeSets);
+
+// Gives the number of marathons answered from the cache of the last result
+// for a user and the number of ones that had to be calculated.
+void marathon_tree_get_cache_stats(unsigned long *hits, unsigned long *misses);
 
 
 #endif //IPP_MARATHON_MARATHON_TREE_H
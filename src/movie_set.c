@@ -0,0 +1,457 @@
+/**
+ * Implementation of movie_set.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include <limits.h>
+#include <string.h>
+#include "movie_set.h"
+#include "defines.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// A batch smaller than the size of the promoted set divided by this
+// is applied one rating at a time, rebuilding the tree would cost more.
+#define MOVIE_SET_MERGE_RATIO 16
+
+// Below this length the binary search stops and the rest of the block
+// is counted linearly.
+#define MOVIE_SET_SCAN_WINDOW 32
+
+// Internal auxiliary function returning true iff the batch of given size
+// should be applied one rating at a time.
+static bool movie_set_is_small_batch(const movie_set_t *set, size_t count);
+
+// Internal auxiliary function replacing the ratings with the given ones,
+// in descending order without repetitions, in the representation
+// the set would have after single updates.
+static void movie_set_rebuild(movie_set_t *set, const int *movies,
+                              size_t size);
+
+// Internal auxiliary function moving the inline ratings into a new tree.
+static void movie_set_promote(movie_set_t *set);
+
+// Internal auxiliary function moving the ratings of the tree inline.
+static void movie_set_demote(movie_set_t *set);
+
+// Internal auxiliary function counting elements greater than the threshold
+// in an arbitrary range, eight or four elements at a time if possible.
+static size_t movie_set_count_greater_linear(const int *data, size_t size,
+                                             int threshold);
+
+
+void movie_set_init(movie_set_t *set) {
+
+    set->size = 0;
+    set->promoted = false;
+}
+
+bool movie_set_insert(movie_set_t *set, int movie) {
+
+    if(set->promoted) {
+
+        if(!btree_insert(set->tree, movie)) {
+            return false;
+        }
+
+        ++set->size;
+
+        return true;
+    }
+
+    unsigned int position = 0;
+
+    while(position < set->size && set->movies[position] > movie) {
+        ++position;
+    }
+
+    if(position < set->size && set->movies[position] == movie) {
+        return false;
+    }
+
+    if(set->size == MOVIE_SET_INLINE) {
+
+        movie_set_promote(set);
+
+        return movie_set_insert(set, movie);
+    }
+
+    memmove(set->movies + position + 1, set->movies + position,
+            (set->size - position) * sizeof(int));
+
+    set->movies[position] = movie;
+    ++set->size;
+
+    return true;
+}
+
+bool movie_set_remove(movie_set_t *set, int movie) {
+
+    if(set->promoted) {
+
+        if(!btree_remove(set->tree, movie)) {
+            return false;
+        }
+
+        // Demote only at half of the inline capacity, so a set moving
+        // around the threshold is not converted back and forth.
+        if(--set->size <= MOVIE_SET_INLINE / 2) {
+            movie_set_demote(set);
+        }
+
+        return true;
+    }
+
+    unsigned int position = 0;
+
+    while(position < set->size && set->movies[position] > movie) {
+        ++position;
+    }
+
+    if(position == set->size || set->movies[position] != movie) {
+        return false;
+    }
+
+    memmove(set->movies + position, set->movies + position + 1,
+            (set->size - position - 1) * sizeof(int));
+
+    --set->size;
+
+    return true;
+}
+
+void movie_set_insert_sorted(movie_set_t *set, const int *movies,
+                             size_t count, bool *added) {
+
+    if(count == 0) {
+        return;
+    }
+
+    if(movie_set_is_small_batch(set, count)) {
+
+        for(size_t i = 0; i < count; ++i) {
+            added[i] = movie_set_insert(set, movies[i]);
+        }
+
+        return;
+    }
+
+    int *merged = malloc((set->size + count) * sizeof(int));
+
+    // Assure that malloc has not failed.
+    NNULL(merged, "movie_set_insert_sorted");
+
+    size_t size = 0;
+    size_t next = 0;
+
+    for(movie_set_block_t block = movie_set_first_block(set);
+        block.size > 0; block = movie_set_next_block(block)) {
+
+        for(size_t i = 0; i < block.size; ++i) {
+
+            // The new ratings bigger than the present one go first.
+            while(next < count && movies[next] > block.data[i]) {
+
+                merged[size++] = movies[next];
+                added[next++] = true;
+            }
+
+            if(next < count && movies[next] == block.data[i]) {
+                added[next++] = false;
+            }
+
+            merged[size++] = block.data[i];
+        }
+    }
+
+    while(next < count) {
+
+        merged[size++] = movies[next];
+        added[next++] = true;
+    }
+
+    movie_set_rebuild(set, merged, size);
+
+    free(merged);
+}
+
+void movie_set_remove_sorted(movie_set_t *set, const int *movies,
+                             size_t count, bool *removed) {
+
+    // Nothing can be removed from an empty set.
+    if(set->size == 0 || movie_set_is_small_batch(set, count)) {
+
+        for(size_t i = 0; i < count; ++i) {
+            removed[i] = movie_set_remove(set, movies[i]);
+        }
+
+        return;
+    }
+
+    int *kept = malloc(set->size * sizeof(int));
+
+    // Assure that malloc has not failed.
+    NNULL(kept, "movie_set_remove_sorted");
+
+    size_t size = 0;
+    size_t next = 0;
+
+    for(movie_set_block_t block = movie_set_first_block(set);
+        block.size > 0; block = movie_set_next_block(block)) {
+
+        for(size_t i = 0; i < block.size; ++i) {
+
+            // The ratings bigger than the present one are not in the set.
+            while(next < count && movies[next] > block.data[i]) {
+                removed[next++] = false;
+            }
+
+            if(next < count && movies[next] == block.data[i]) {
+                removed[next++] = true;
+            }
+            else {
+                kept[size++] = block.data[i];
+            }
+        }
+    }
+
+    while(next < count) {
+        removed[next++] = false;
+    }
+
+    movie_set_rebuild(set, kept, size);
+
+    free(kept);
+}
+
+void movie_set_build_sorted(movie_set_t *set, const int *movies,
+                            size_t count) {
+
+    movie_set_rebuild(set, movies, count);
+}
+
+bool movie_set_contains(const movie_set_t *set, int movie) {
+
+    if(set->promoted) {
+        return btree_contains(set->tree, movie);
+    }
+
+    for(unsigned int i = 0; i < set->size && set->movies[i] >= movie; ++i) {
+
+        if(set->movies[i] == movie) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+long movie_set_max(const movie_set_t *set) {
+
+    if(set->size == 0) {
+        return -1;
+    }
+
+    return set->promoted ? set->tree->first->keys[0] : set->movies[0];
+}
+
+movie_set_block_t movie_set_first_block(const movie_set_t *set) {
+
+    movie_set_block_t block;
+
+    if(set->promoted) {
+
+        block.data = set->tree->first->keys;
+        block.size = set->tree->first->size;
+        block.leaf = set->tree->first;
+    }
+    else {
+
+        block.data = set->movies;
+        block.size = set->size;
+        block.leaf = NULL;
+    }
+
+    return block;
+}
+
+movie_set_block_t movie_set_next_block(movie_set_block_t block) {
+
+    const btree_leaf_t *next = block.leaf == NULL ? NULL : block.leaf->next;
+
+    block.data = next == NULL ? NULL : next->keys;
+    block.size = next == NULL ? 0 : next->size;
+    block.leaf = next;
+
+    return block;
+}
+
+movie_set_block_t movie_set_seek(const movie_set_t *set, long bound,
+                                 size_t *position) {
+
+    movie_set_block_t block = movie_set_first_block(set);
+
+    // Only the leaf the rating would be in is searched.
+    if(set->promoted && bound <= INT_MAX) {
+
+        const btree_leaf_t *leaf = btree_find_leaf(
+                set->tree, bound > INT_MIN ? (int) (bound - 1) : INT_MIN);
+
+        block.data = leaf->keys;
+        block.size = leaf->size;
+        block.leaf = leaf;
+    }
+
+    *position = movie_set_count_greater(block, bound - 1);
+
+    // All the ratings of the leaf are too high, the next one starts
+    // with the rating.
+    if(*position == block.size) {
+
+        block = movie_set_next_block(block);
+        *position = 0;
+    }
+
+    return block;
+}
+
+size_t movie_set_count_greater(movie_set_block_t block, long threshold) {
+
+    if(threshold >= INT_MAX) {
+        return 0;
+    }
+
+    if(threshold < INT_MIN) {
+        return block.size;
+    }
+
+    int clamped = (int) threshold;
+
+    size_t low = 0;
+    size_t high = block.size;
+
+    while(high - low > MOVIE_SET_SCAN_WINDOW) {
+
+        size_t mid = low + (high - low) / 2;
+
+        if(block.data[mid] > clamped) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low + movie_set_count_greater_linear(block.data + low, high - low,
+                                                clamped);
+}
+
+void movie_set_clear(movie_set_t *set) {
+
+    if(set->promoted) {
+        btree_destroy(&set->tree);
+    }
+
+    movie_set_init(set);
+}
+
+static bool movie_set_is_small_batch(const movie_set_t *set, size_t count) {
+
+    return set->promoted && count * MOVIE_SET_MERGE_RATIO < set->size;
+}
+
+static void movie_set_rebuild(movie_set_t *set, const int *movies,
+                              size_t size) {
+
+    // The same hysteresis as for single updates.
+    bool promoted = set->promoted ? size > MOVIE_SET_INLINE / 2
+                                  : size > MOVIE_SET_INLINE;
+
+    movie_set_clear(set);
+
+    if(promoted) {
+
+        set->tree = btree_make_sorted(movies, size);
+        set->promoted = true;
+    }
+    else {
+        memcpy(set->movies, movies, size * sizeof(int));
+    }
+
+    set->size = (unsigned int) size;
+}
+
+static void movie_set_promote(movie_set_t *set) {
+
+    btree_t *tree = btree_make();
+
+    for(unsigned int i = 0; i < set->size; ++i) {
+        btree_insert(tree, set->movies[i]);
+    }
+
+    set->tree = tree;
+    set->promoted = true;
+}
+
+static void movie_set_demote(movie_set_t *set) {
+
+    btree_t *tree = set->tree;
+    unsigned int size = 0;
+
+    for(const btree_leaf_t *leaf = tree->first; leaf != NULL;
+        leaf = leaf->next) {
+
+        memcpy(set->movies + size, leaf->keys, leaf->size * sizeof(int));
+        size += leaf->size;
+    }
+
+    btree_destroy(&tree);
+
+    set->promoted = false;
+}
+
+static size_t movie_set_count_greater_linear(const int *data, size_t size,
+                                             int threshold) {
+
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+
+    __m256i thresholds = _mm256_set1_epi32(threshold);
+
+    for(; i + 8 <= size; i += 8) {
+
+        __m256i values = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i greater = _mm256_cmpgt_epi32(values, thresholds);
+
+        count += __builtin_popcount(
+                _mm256_movemask_ps(_mm256_castsi256_ps(greater)));
+    }
+
+#elif defined(__SSE2__)
+
+    __m128i thresholds = _mm_set1_epi32(threshold);
+
+    for(; i + 4 <= size; i += 4) {
+
+        __m128i values = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i greater = _mm_cmpgt_epi32(values, thresholds);
+
+        count += __builtin_popcount(
+                _mm_movemask_ps(_mm_castsi128_ps(greater)));
+    }
+
+#endif
+
+    for(; i < size; ++i) {
+        count += data[i] > threshold;
+    }
+
+    return count;
+}
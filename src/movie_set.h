@@ -0,0 +1,103 @@
+/**
+ * Adaptive set of movie ratings in descending order. Small sets are kept
+ * inline in the set object with no allocation, sets which outgrow it are
+ * promoted to a B+ tree and demoted back once they shrink to half of
+ * the inline capacity.
+ * Updates of inline sets take time linear in their tiny size, updates
+ * of promoted ones take logarithmic time. A batch of sorted ratings is
+ * merged in time linear in the sizes of the set and the batch. Reading
+ * the highest rating takes constant time.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef MOVIE_SET_H
+#define MOVIE_SET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "btree.h"
+
+// Maximal number of ratings kept inline.
+#define MOVIE_SET_INLINE 8
+
+// The set, either the first size elements of movies or the tree.
+typedef struct movie_set_t {
+
+    unsigned int size;
+    bool promoted;
+
+    union {
+        int movies[MOVIE_SET_INLINE];
+        btree_t *tree;
+    };
+
+} movie_set_t;
+
+// Contiguous run of ratings in descending order, the whole inline set
+// or a single leaf of the tree.
+typedef struct movie_set_block_t {
+
+    const int *data;
+    size_t size;
+
+    // Leaf holding the block, NULL for an inline set.
+    const btree_leaf_t *leaf;
+
+} movie_set_block_t;
+
+// Makes the set empty and inline. Does not release anything.
+void movie_set_init(movie_set_t *set);
+
+// Inserts the rating, promoting the set if it does not fit inline.
+// Returns false and does nothing if the rating is already present.
+bool movie_set_insert(movie_set_t *set, int movie);
+
+// Removes the rating, demoting the set if it is small enough.
+// Returns false and does nothing if the rating is not present.
+bool movie_set_remove(movie_set_t *set, int movie);
+
+// Inserts the count ratings, given in descending order without repetitions.
+// Sets added[i] to true iff the i-th rating was not present before.
+void movie_set_insert_sorted(movie_set_t *set, const int *movies,
+                             size_t count, bool *added);
+
+// Removes the count ratings, given in descending order without repetitions.
+// Sets removed[i] to true iff the i-th rating was present before.
+void movie_set_remove_sorted(movie_set_t *set, const int *movies,
+                             size_t count, bool *removed);
+
+// Makes the empty set hold the count ratings, given in descending order
+// without repetitions, in the representation they would get inserted
+// one by one. Takes time linear in their number.
+void movie_set_build_sorted(movie_set_t *set, const int *movies,
+                            size_t count);
+
+// Returns true iff the rating is present.
+bool movie_set_contains(const movie_set_t *set, int movie);
+
+// Returns the highest rating or -1 if the set is empty.
+long movie_set_max(const movie_set_t *set);
+
+// Gives the block with the highest ratings, empty iff the set is empty.
+movie_set_block_t movie_set_first_block(const movie_set_t *set);
+
+// Gives the block after the given one, empty after the last one.
+movie_set_block_t movie_set_next_block(movie_set_block_t block);
+
+// Gives the block with the highest rating below the bound and sets position
+// to the index of the rating in it. The block is empty iff there is no
+// such rating. Takes logarithmic time.
+movie_set_block_t movie_set_seek(const movie_set_t *set, long bound,
+                                 size_t *position);
+
+// Returns the number of ratings of the block strictly greater than
+// the threshold. Narrows the range with a binary search and counts
+// the last few ratings with SIMD comparisons when they are available.
+size_t movie_set_count_greater(movie_set_block_t block, long threshold);
+
+// Releases all the memory held by the set and makes it empty and inline.
+void movie_set_clear(movie_set_t *set);
+
+#endif // MOVIE_SET_H
@@ -0,0 +1,299 @@
+/**
+ * Implementation of oplog.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "oplog.h"
+#include "defines.h"
+
+// Capacity of the buffers in records, they grow when the disk is slow.
+#define OPLOG_INITIAL_RECORDS 1024
+
+// Internal function of the background thread committing the records.
+static void *oplog_flusher(void *arg);
+
+// Internal auxiliary function writing the whole buffer to the file.
+// Returns false and leaves errno set if it fails.
+static bool oplog_write(oplog_t *log, const char *data, size_t size);
+
+
+oplog_t *oplog_open(const char *path, size_t recordSize, size_t groupSize,
+                    unsigned int groupTime) {
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+    if(fd < 0) {
+        return NULL;
+    }
+
+    struct stat status;
+
+    // Cut off a record torn by a crash, so that the next ones are aligned.
+    if(fstat(fd, &status) != 0 ||
+       ftruncate(fd, status.st_size - status.st_size % (off_t) recordSize)
+       != 0) {
+
+        close(fd);
+
+        return NULL;
+    }
+
+    oplog_t *log = malloc(sizeof(oplog_t));
+
+    // Assure that malloc has not failed.
+    NNULL(log, "oplog_open");
+
+    log->fd = fd;
+    log->recordSize = recordSize;
+    log->groupSize = groupSize > 0 ? groupSize : 1;
+    log->groupTime = groupTime;
+
+    log->size = 0;
+    log->capacity = OPLOG_INITIAL_RECORDS * recordSize;
+    log->data = malloc(log->capacity);
+    log->spareCapacity = log->capacity;
+    log->spare = malloc(log->spareCapacity);
+
+    // Assure that malloc has not failed.
+    NNULL(log->data, "data/oplog_open");
+    NNULL(log->spare, "spare/oplog_open");
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_mutex_init(&log->commitLock, NULL);
+    pthread_cond_init(&log->wake, NULL);
+    log->stopping = false;
+    log->error = 0;
+
+    int error = pthread_create(&log->flusher, NULL, oplog_flusher, log);
+
+    if(error != 0) {
+
+        close(fd);
+
+        pthread_mutex_destroy(&log->lock);
+        pthread_mutex_destroy(&log->commitLock);
+        pthread_cond_destroy(&log->wake);
+
+        free(log->data);
+        free(log->spare);
+        free(log);
+
+        errno = error;
+
+        return NULL;
+    }
+
+    return log;
+}
+
+void oplog_append(oplog_t *log, const char *record) {
+
+    NNULL(log, "oplog_append");
+
+    pthread_mutex_lock(&log->lock);
+
+    if(log->size + log->recordSize > log->capacity) {
+
+        log->capacity *= 2;
+        log->data = realloc(log->data, log->capacity);
+
+        // Assure that realloc has not failed.
+        NNULL(log->data, "oplog_append");
+    }
+
+    memcpy(log->data + log->size, record, log->recordSize);
+    log->size += log->recordSize;
+
+    // The first record of a group starts the timer, a full group
+    // is committed right away.
+    if(log->size == log->recordSize ||
+       log->size == log->groupSize * log->recordSize) {
+
+        pthread_cond_signal(&log->wake);
+    }
+
+    pthread_mutex_unlock(&log->lock);
+}
+
+bool oplog_commit(oplog_t *log) {
+
+    NNULL(log, "oplog_commit");
+
+    pthread_mutex_lock(&log->commitLock);
+    pthread_mutex_lock(&log->lock);
+
+    // Take the appended records, so that appending can go on
+    // while they are written.
+    char *data = log->data;
+    size_t size = log->size;
+    size_t capacity = log->capacity;
+
+    log->data = log->spare;
+    log->capacity = log->spareCapacity;
+    log->size = 0;
+
+    pthread_mutex_unlock(&log->lock);
+
+    // After a failure the file may end with a part of a group, so nothing
+    // is written after it any more.
+    if(size > 0 && log->error == 0 &&
+       (!oplog_write(log, data, size) || fsync(log->fd) != 0)) {
+
+        log->error = errno;
+    }
+
+    bool committed = log->error == 0;
+
+    log->spare = data;
+    log->spareCapacity = capacity;
+
+    pthread_mutex_unlock(&log->commitLock);
+
+    return committed;
+}
+
+int oplog_error(oplog_t *log) {
+
+    NNULL(log, "oplog_error");
+
+    pthread_mutex_lock(&log->commitLock);
+
+    int error = log->error;
+
+    pthread_mutex_unlock(&log->commitLock);
+
+    return error;
+}
+
+bool oplog_truncate(oplog_t *log) {
+
+    NNULL(log, "oplog_truncate");
+
+    pthread_mutex_lock(&log->commitLock);
+    pthread_mutex_lock(&log->lock);
+
+    log->size = 0;
+
+    bool truncated = ftruncate(log->fd, 0) == 0 && fsync(log->fd) == 0;
+
+    pthread_mutex_unlock(&log->lock);
+    pthread_mutex_unlock(&log->commitLock);
+
+    return truncated;
+}
+
+void oplog_close(oplog_t **log) {
+
+    NNULL(*log, "oplog_close");
+
+    pthread_mutex_lock(&(*log)->lock);
+
+    (*log)->stopping = true;
+
+    pthread_cond_signal(&(*log)->wake);
+    pthread_mutex_unlock(&(*log)->lock);
+
+    pthread_join((*log)->flusher, NULL);
+
+    oplog_commit(*log);
+
+    close((*log)->fd);
+
+    pthread_mutex_destroy(&(*log)->lock);
+    pthread_mutex_destroy(&(*log)->commitLock);
+    pthread_cond_destroy(&(*log)->wake);
+
+    free((*log)->data);
+    free((*log)->spare);
+    free(*log);
+
+    *log = NULL;
+}
+
+static void *oplog_flusher(void *arg) {
+
+    oplog_t *log = arg;
+
+    pthread_mutex_lock(&log->lock);
+
+    while(!log->stopping) {
+
+        if(log->size == 0) {
+
+            pthread_cond_wait(&log->wake, &log->lock);
+
+            continue;
+        }
+
+        // Wait for the rest of the group, but no longer than groupTime.
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        deadline.tv_sec += log->groupTime / 1000;
+        deadline.tv_nsec += (long) (log->groupTime % 1000) * 1000000;
+
+        if(deadline.tv_nsec >= 1000000000) {
+
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        while(!log->stopping &&
+              log->size < log->groupSize * log->recordSize &&
+              pthread_cond_timedwait(&log->wake, &log->lock,
+                                     &deadline) != ETIMEDOUT) {
+        }
+
+        pthread_mutex_unlock(&log->lock);
+
+        // A failure is recorded for the owner of the log to find.
+        oplog_commit(log);
+
+        pthread_mutex_lock(&log->lock);
+    }
+
+    pthread_mutex_unlock(&log->lock);
+
+    return NULL;
+}
+
+static bool oplog_write(oplog_t *log, const char *data, size_t size) {
+
+    size_t written = 0;
+
+    while(written < size) {
+
+        ssize_t bytesWritten = write(log->fd, data + written,
+                                     size - written);
+
+        if(bytesWritten < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if(bytesWritten < 0) {
+            return false;
+        }
+
+        // Nothing written and no error, the disk takes nothing more.
+        if(bytesWritten == 0) {
+
+            errno = EIO;
+
+            return false;
+        }
+
+        written += (size_t) bytesWritten;
+    }
+
+    return true;
+}
@@ -0,0 +1,82 @@
+/**
+ * Append-only log of operations with group commit. Records are buffered
+ * in memory and written out and synchronised to the disk together, when
+ * groupSize of them are waiting or groupTime milliseconds after the first
+ * of them, whichever comes first. The writes are done by a background
+ * thread, so appending never waits for the disk.
+ * A crash loses at most the last group of records, so whatever acknowledges
+ * a record has to wait for oplog_commit, which closes the group early.
+ * A truncated last record is cut off when the log is opened again.
+ * A failed write or synchronisation, also one of the background thread,
+ * is only recorded: nothing more is written after it and every later
+ * commit fails, so the owner of the log decides how to stop.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef OPLOG_H
+#define OPLOG_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Log of records of recordSize bytes appended to a single file.
+typedef struct oplog_t {
+
+    int fd;
+    size_t recordSize;
+    size_t groupSize;
+    unsigned int groupTime;
+
+    // Records appended and not yet taken by a commit.
+    char *data;
+    size_t size;
+    size_t capacity;
+
+    // Records being written by a commit.
+    char *spare;
+    size_t spareCapacity;
+
+    // The lock guards the buffer of appended records, the flusher waits
+    // on wake for a full group or for the log to close. Commits are
+    // serialised by commitLock.
+    pthread_mutex_t lock;
+    pthread_mutex_t commitLock;
+    pthread_cond_t wake;
+    pthread_t flusher;
+    bool stopping;
+
+    // Error number of the first failed write or synchronisation, 0 if
+    // there was none. Guarded by commitLock.
+    int error;
+
+} oplog_t;
+
+// Opens the log at the given path for appending, creating it if needed.
+// Returns NULL and leaves errno set if the file could not be opened
+// or the background thread could not be started.
+oplog_t *oplog_open(const char *path, size_t recordSize, size_t groupSize,
+                    unsigned int groupTime);
+
+// Appends a single record.
+void oplog_append(oplog_t *log, const char *record);
+
+// Writes out all the appended records and waits until they are on the disk.
+// Returns false if the log has failed, now or before, and the records
+// may not be on the disk.
+bool oplog_commit(oplog_t *log);
+
+// Returns the error number of the failure of the log, 0 if it has not failed.
+int oplog_error(oplog_t *log);
+
+// Drops all the records, both appended and written.
+// Returns false if the file could not be truncated.
+bool oplog_truncate(oplog_t *log);
+
+// Commits the remaining records, unless the log has failed, releases
+// the resources of the log and NULLs the pointer.
+void oplog_close(oplog_t **log);
+
+#endif // OPLOG_H
@@ -0,0 +1,298 @@
+/**
+ * Implementation of output.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "output.h"
+#include "defines.h"
+
+// Size of the output buffer.
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+// Maximal number of characters in the decimal representation of a long.
+#define OUTPUT_LONG_LENGTH 20
+
+// Decimal representations of all two digit numbers, so that the conversion
+// takes a single division per two digits.
+static const char digitPairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233"
+        "34353637383940414243444546474849505152535455565758596061626364656667"
+        "6869707172737475767778798081828384858687888990919293949596979899";
+
+// Internal auxiliary function flushing the partner if it has pending data.
+static void output_flush_partner(output_t *output);
+
+// Internal auxiliary function making room for length more bytes
+// in the buffer of the deferred output.
+static void output_grow(output_t *output, size_t length);
+
+
+output_t *output_open(int fd) {
+
+    output_t *output = malloc(sizeof(output_t));
+
+    // Assure that malloc has not failed.
+    NNULL(output, "output_open");
+
+    output->fd = fd;
+    output->size = 0;
+    output->capacity = OUTPUT_BUFFER_SIZE;
+    output->data = malloc(output->capacity);
+    output->partner = NULL;
+    output->deferred = false;
+    output->barrier = NULL;
+
+    // Assure that malloc has not failed.
+    NNULL(output->data, "output_open");
+
+    return output;
+}
+
+output_t *output_open_deferred(int fd) {
+
+    output_t *output = output_open(fd);
+
+    output->deferred = true;
+
+    return output;
+}
+
+void output_pair(output_t *first, output_t *second) {
+
+    NNULL(first, "first/output_pair");
+    NNULL(second, "second/output_pair");
+
+    first->partner = second;
+    second->partner = first;
+}
+
+void output_set_barrier(output_t *output, output_barrier_t barrier) {
+
+    NNULL(output, "output_set_barrier");
+
+    output->barrier = barrier;
+}
+
+void output_write(output_t *output, const char *data, size_t length) {
+
+    NNULL(output, "output_write");
+
+    output_flush_partner(output);
+
+    if(output->deferred) {
+        output_grow(output, length);
+    }
+
+    if(output->size + length > output->capacity) {
+
+        output_flush(output);
+
+        // Too big to be buffered at all.
+        if(length > output->capacity) {
+
+            if(output->barrier != NULL && !output->barrier()) {
+                return;
+            }
+
+            while(length > 0) {
+
+                ssize_t written = write(output->fd, data, length);
+
+                if(written < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if(written <= 0) {
+                    return;
+                }
+
+                data += written;
+                length -= (size_t) written;
+            }
+
+            return;
+        }
+    }
+
+    memcpy(output->data + output->size, data, length);
+    output->size += length;
+}
+
+void output_write_string(output_t *output, const char *string) {
+
+    output_write(output, string, strlen(string));
+}
+
+void output_write_char(output_t *output, char character) {
+
+    NNULL(output, "output_write_char");
+
+    output_flush_partner(output);
+
+    if(output->deferred) {
+        output_grow(output, 1);
+    }
+
+    if(output->size == output->capacity) {
+        output_flush(output);
+    }
+
+    output->data[output->size++] = character;
+}
+
+void output_write_long(output_t *output, long value) {
+
+    char buffer[OUTPUT_LONG_LENGTH + 1];
+    char *end = buffer + sizeof(buffer);
+    char *start = end;
+
+    // Work on the magnitude as unsigned, so that LONG_MIN works as well.
+    unsigned long magnitude = value < 0 ? 0ul - (unsigned long) value
+                                        : (unsigned long) value;
+
+    while(magnitude >= 100) {
+
+        unsigned long pair = magnitude % 100;
+        magnitude /= 100;
+
+        start -= 2;
+        memcpy(start, digitPairs + 2 * pair, 2);
+    }
+
+    if(magnitude >= 10) {
+
+        start -= 2;
+        memcpy(start, digitPairs + 2 * magnitude, 2);
+    }
+    else {
+        *--start = (char) ('0' + magnitude);
+    }
+
+    if(value < 0) {
+        *--start = '-';
+    }
+
+    output_write(output, start, (size_t) (end - start));
+}
+
+void output_flush(output_t *output) {
+
+    NNULL(output, "output_flush");
+
+    if(output->size > 0 && output->barrier != NULL && !output->barrier()) {
+
+        output->size = 0;
+
+        return;
+    }
+
+    size_t position = 0;
+
+    while(position < output->size) {
+
+        ssize_t written = write(output->fd, output->data + position,
+                                output->size - position);
+
+        if(written < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // Nothing more can be done if the descriptor is broken.
+        if(written <= 0) {
+            break;
+        }
+
+        position += (size_t) written;
+    }
+
+    output->size = 0;
+}
+
+bool output_send(output_t *output) {
+
+    NNULL(output, "output_send");
+
+    if(output->size > 0 && output->barrier != NULL && !output->barrier()) {
+
+        output->size = 0;
+
+        return false;
+    }
+
+    size_t position = 0;
+    bool correct = true;
+
+    while(position < output->size) {
+
+        ssize_t written = write(output->fd, output->data + position,
+                                output->size - position);
+
+        if(written < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // The descriptor takes nothing more for now.
+        if(written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+
+        if(written <= 0) {
+
+            correct = false;
+
+            break;
+        }
+
+        position += (size_t) written;
+    }
+
+    memmove(output->data, output->data + position, output->size - position);
+    output->size -= position;
+
+    return correct;
+}
+
+void output_close(output_t **output) {
+
+    NNULL(*output, "output_close");
+
+    output_flush(*output);
+
+    if((*output)->partner != NULL) {
+        (*output)->partner->partner = NULL;
+    }
+
+    free((*output)->data);
+    free(*output);
+
+    *output = NULL;
+}
+
+static void output_flush_partner(output_t *output) {
+
+    if(output->partner != NULL && output->partner->size > 0) {
+        output_flush(output->partner);
+    }
+}
+
+static void output_grow(output_t *output, size_t length) {
+
+    if(output->size + length <= output->capacity) {
+        return;
+    }
+
+    while(output->size + length > output->capacity) {
+        output->capacity *= 2;
+    }
+
+    output->data = realloc(output->data, output->capacity);
+
+    // Assure that realloc has not failed.
+    NNULL(output->data, "output_grow");
+}
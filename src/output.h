@@ -0,0 +1,84 @@
+/**
+ * Buffered output. Everything is gathered in a large buffer and written
+ * to the descriptor with a single write when it fills up or on flush.
+ * Two outputs can be paired to keep the relative order of their lines
+ * for a consumer that merges them: writing to one of them first flushes
+ * whatever is pending in the other.
+ * A deferred output never writes by itself, its buffer grows instead,
+ * and it is sent without blocking whenever the descriptor is writable.
+ * An output can have a barrier, called right before anything buffered
+ * is written out, which holds the data back until it may be seen,
+ * or drops it if it may never be.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Called before the buffered data of an output is written out.
+// Returns false if the data must never be seen, it is dropped then.
+typedef bool (*output_barrier_t)(void);
+
+// Buffered output to a single descriptor.
+typedef struct output_t {
+
+    int fd;
+
+    char *data;
+    size_t size;
+    size_t capacity;
+
+    // Output flushed before every write to this one, NULL if not paired.
+    struct output_t *partner;
+
+    // True iff the data is only written out by output_send.
+    bool deferred;
+
+    // Called before every write of the data, NULL if there is none.
+    output_barrier_t barrier;
+
+} output_t;
+
+// Makes a new output writing to the descriptor, which is not closed
+// by output_close.
+output_t *output_open(int fd);
+
+// Makes a new deferred output writing to the non-blocking descriptor,
+// which is not closed by output_close.
+output_t *output_open_deferred(int fd);
+
+// Pairs the two outputs, so that the order of writes to them is kept.
+void output_pair(output_t *first, output_t *second);
+
+// Sets the barrier called before the data is written out, NULL for none.
+void output_set_barrier(output_t *output, output_barrier_t barrier);
+
+// Appends length bytes of data.
+void output_write(output_t *output, const char *data, size_t length);
+
+// Appends a null terminated string.
+void output_write_string(output_t *output, const char *string);
+
+// Appends a single character.
+void output_write_char(output_t *output, char character);
+
+// Appends the decimal representation of the number.
+void output_write_long(output_t *output, long value);
+
+// Writes out everything that is buffered.
+void output_flush(output_t *output);
+
+// Writes out as much of the buffered data as the descriptor takes without
+// blocking, the rest stays buffered. Returns false if the descriptor
+// is broken or the barrier dropped the data.
+bool output_send(output_t *output);
+
+// Flushes the output, releases its resources and NULLs the pointer.
+void output_close(output_t **output);
+
+#endif // OUTPUT_H
@@ -0,0 +1,382 @@
+/**
+ * Implementation of server.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "defines.h"
+
+// Maximal number of connections waiting to be accepted.
+#define SERVER_BACKLOG 128
+
+// Maximal number of events taken from the epoll at once.
+#define SERVER_EVENTS 64
+
+// Number of bytes of unsent responses above which the client
+// is not read from.
+#define SERVER_OUTPUT_LIMIT (1 << 20)
+
+// Internal auxiliary function accepting all the waiting connections.
+static void server_accept(server_t *server);
+
+// Internal auxiliary function handling the events of the client.
+static void server_notify(server_t *server, server_client_t *client,
+                          unsigned int events);
+
+// Internal auxiliary function serving a turn of every client that may
+// have requests waiting.
+static void server_serve(server_t *server);
+
+// Internal auxiliary function sending what the client takes of its
+// responses and choosing the events it waits for. Closes the client if it
+// is broken or closing with everything sent.
+// Returns false if the client was closed.
+static bool server_update(server_t *server, server_client_t *client);
+
+// Internal auxiliary function closing the client and releasing it.
+static void server_drop(server_t *server, server_client_t *client);
+
+// Internal auxiliary function making the descriptor non-blocking.
+// Returns false if it failed.
+static bool server_set_nonblocking(int fd);
+
+
+server_t *server_open(const char *path, server_handler_t handler,
+                      server_closer_t closer) {
+
+    NNULL(path, "server_open");
+
+    struct sockaddr_un address;
+
+    if(strlen(path) >= sizeof(address.sun_path)) {
+
+        errno = ENAMETOOLONG;
+
+        return NULL;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(listener < 0) {
+        return NULL;
+    }
+
+    if(bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0) {
+
+        int error = errno;
+
+        close(listener);
+        errno = error;
+
+        return NULL;
+    }
+
+    // Termination is only received by the loop, as an event. The mask is
+    // inherited by the threads started later, so none of them takes it.
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    // A client gone before reading its responses is just closed.
+    struct sigaction ignore;
+
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGPIPE, &ignore, NULL);
+
+    int epoll = epoll_create1(0);
+    int signals = signalfd(-1, &mask, SFD_NONBLOCK);
+
+    server_t *server = malloc(sizeof(server_t));
+
+    // Assure that malloc has not failed.
+    NNULL(server, "server_open");
+
+    server->path = strdup(path);
+    server->listener = listener;
+    server->epoll = epoll;
+    server->signals = signals;
+    server->handler = handler;
+    server->closer = closer;
+
+    // Assure that strdup has not failed.
+    NNULL(server->path, "path/server_open");
+
+    dlist_init(&server->clients);
+    dlist_init(&server->runnable);
+
+    server->stopping = false;
+
+    struct epoll_event listenerEvent = {EPOLLIN, {.ptr = &server->listener}};
+    struct epoll_event signalEvent = {EPOLLIN, {.ptr = &server->signals}};
+
+    if(epoll < 0 || signals < 0 ||
+       listen(listener, SERVER_BACKLOG) != 0 ||
+       !server_set_nonblocking(listener) ||
+       epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &listenerEvent) != 0 ||
+       epoll_ctl(epoll, EPOLL_CTL_ADD, signals, &signalEvent) != 0) {
+
+        int error = errno;
+
+        server_close(&server);
+        errno = error;
+
+        return NULL;
+    }
+
+    return server;
+}
+
+void server_run(server_t *server) {
+
+    NNULL(server, "server_run");
+
+    struct epoll_event events[SERVER_EVENTS];
+    bool running = true;
+
+    while(running && !server->stopping) {
+
+        // Clients left with requests are served again right away.
+        int timeout = dlist_is_empty(&server->runnable) ? -1 : 0;
+        int count = epoll_wait(server->epoll, events, SERVER_EVENTS, timeout);
+
+        if(count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if(count < 0) {
+
+            perror("epoll_wait");
+
+            return;
+        }
+
+        for(int i = 0; i < count; ++i) {
+
+            void *source = events[i].data.ptr;
+
+            if(source == &server->listener) {
+                server_accept(server);
+            }
+            else if(source == &server->signals) {
+                running = false;
+            }
+            else {
+                server_notify(server, source, events[i].events);
+            }
+        }
+
+        server_serve(server);
+    }
+}
+
+void server_stop(server_t *server) {
+
+    NNULL(server, "server_stop");
+
+    server->stopping = true;
+}
+
+void server_close(server_t **server) {
+
+    NNULL(*server, "server_close");
+
+    while(!dlist_is_empty(&(*server)->clients)) {
+
+        server_client_t *client = DLIST_ENTRY(
+                dlist_get_front(&(*server)->clients), server_client_t, link);
+
+        output_send(client->output);
+        server_drop(*server, client);
+    }
+
+    if((*server)->epoll >= 0) {
+        close((*server)->epoll);
+    }
+
+    if((*server)->signals >= 0) {
+        close((*server)->signals);
+    }
+
+    close((*server)->listener);
+    unlink((*server)->path);
+
+    free((*server)->path);
+    free(*server);
+
+    *server = NULL;
+}
+
+static void server_accept(server_t *server) {
+
+    while(true) {
+
+        int fd = accept(server->listener, NULL, NULL);
+
+        if(fd < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if(fd < 0) {
+
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+
+            return;
+        }
+
+        server_client_t *client = malloc(sizeof(server_client_t));
+
+        // Assure that malloc has not failed.
+        NNULL(client, "server_accept");
+
+        client->fd = fd;
+        client->closing = false;
+        client->events = EPOLLIN;
+
+        struct epoll_event event = {EPOLLIN, {.ptr = client}};
+
+        if(!server_set_nonblocking(fd) ||
+           epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+
+            perror("accept");
+            close(fd);
+            free(client);
+
+            continue;
+        }
+
+        client->input = input_open(fd);
+        client->output = output_open_deferred(fd);
+
+        dlist_push_back(&server->clients, &client->link);
+        dlist_init_node(&client->runnable);
+    }
+}
+
+static void server_notify(server_t *server, server_client_t *client,
+                          unsigned int events) {
+
+    if((events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) &&
+       client->output->size > 0 && !server_update(server, client)) {
+
+        return;
+    }
+
+    // An error or hang up is found out by reading.
+    if((events & (EPOLLIN | EPOLLERR | EPOLLHUP)) &&
+       (client->events & EPOLLIN) && client->runnable.next == NULL) {
+
+        dlist_push_back(&server->runnable, &client->runnable);
+    }
+}
+
+static void server_serve(server_t *server) {
+
+    dnode_t *node = dlist_get_front(&server->runnable);
+
+    while(node != NULL) {
+
+        // The client may be closed below, together with its links.
+        dnode_t *next = dlist_next(node);
+        server_client_t *client = DLIST_ENTRY(node, server_client_t,
+                                              runnable);
+
+        if(!server->handler(client)) {
+            dlist_remove(node);
+        }
+
+        if(client->input->finished) {
+            client->closing = true;
+        }
+
+        server_update(server, client);
+
+        node = next;
+    }
+}
+
+static bool server_update(server_t *server, server_client_t *client) {
+
+    if(!output_send(client->output) ||
+       (client->closing && client->output->size == 0)) {
+
+        server_drop(server, client);
+
+        return false;
+    }
+
+    bool throttled = client->output->size > SERVER_OUTPUT_LIMIT;
+    unsigned int events = client->output->size > 0 ? EPOLLOUT : 0;
+
+    if(!client->closing && !throttled) {
+        events |= EPOLLIN;
+    }
+
+    if(events != client->events) {
+
+        struct epoll_event event = {events, {.ptr = client}};
+
+        epoll_ctl(server->epoll, EPOLL_CTL_MOD, client->fd, &event);
+
+        // Reading again, the requests read before may be waiting.
+        if((events & EPOLLIN) && client->runnable.next == NULL) {
+            dlist_push_back(&server->runnable, &client->runnable);
+        }
+
+        client->events = events;
+    }
+
+    if(!(events & EPOLLIN) && client->runnable.next != NULL) {
+        dlist_remove(&client->runnable);
+    }
+
+    return true;
+}
+
+static void server_drop(server_t *server, server_client_t *client) {
+
+    server->closer(client);
+
+    epoll_ctl(server->epoll, EPOLL_CTL_DEL, client->fd, NULL);
+
+    if(client->runnable.next != NULL) {
+        dlist_remove(&client->runnable);
+    }
+
+    dlist_remove(&client->link);
+
+    input_close(&client->input);
+    output_close(&client->output);
+    close(client->fd);
+
+    free(client);
+}
+
+static bool server_set_nonblocking(int fd) {
+
+    int flags = fcntl(fd, F_GETFL);
+
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
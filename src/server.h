@@ -0,0 +1,91 @@
+/**
+ * Event loop serving many clients over a Unix domain socket in a single
+ * thread. Every client has its own input and a deferred output, its
+ * requests are handed to the handler in the order they arrive, as many
+ * as it takes in a turn, and the responses are sent back without blocking.
+ * Clients with requests waiting are served in turns, so one sending
+ * a long pipeline does not hold up the others, and a client whose
+ * responses pile up unsent is not read from until they are taken.
+ * The loop runs until SIGINT or SIGTERM, which are blocked in the whole
+ * process once the server is open and only received by the loop.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+#include "dlist.h"
+#include "input.h"
+#include "output.h"
+
+// A single connected client.
+typedef struct server_client_t {
+
+    int fd;
+    input_t *input;
+    output_t *output;
+
+    // Set by the handler to close the client once its responses are sent.
+    // Also set when the client stops sending.
+    bool closing;
+
+    // Events the client is waiting for.
+    unsigned int events;
+
+    // Links on the list of all the clients and on the list of the ones
+    // that may have requests waiting.
+    dnode_t link;
+    dnode_t runnable;
+
+} server_client_t;
+
+// Serves a turn of the client's requests read from its input, writing
+// the responses to its output. Returns true if requests may still be
+// waiting, false if the input has nothing more for now.
+typedef bool (*server_handler_t)(server_client_t *client);
+
+// Called right before the client is closed.
+typedef void (*server_closer_t)(server_client_t *client);
+
+// The server.
+typedef struct server_t {
+
+    // Path of the socket, removed when the server is closed.
+    char *path;
+
+    int listener;
+    int epoll;
+    int signals;
+
+    server_handler_t handler;
+    server_closer_t closer;
+
+    dlist_t clients;
+    dlist_t runnable;
+
+    // Set by server_stop.
+    bool stopping;
+
+} server_t;
+
+// Makes a new server listening on the socket at the given path, which must
+// not exist yet. Returns NULL and leaves errno set if it could not be made.
+server_t *server_open(const char *path, server_handler_t handler,
+                      server_closer_t closer);
+
+// Serves the clients until the process is told to stop or server_stop
+// is called.
+void server_run(server_t *server);
+
+// Makes server_run return once the current turn of the clients is served.
+// Can only be called from the handler.
+void server_stop(server_t *server);
+
+// Closes all the clients, sending them what is possible without waiting,
+// releases the resources of the server and NULLs the pointer.
+void server_close(server_t **server);
+
+#endif // SERVER_H
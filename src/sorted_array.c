@@ -0,0 +1,94 @@
+/**
+ * Implementation of sorted_array.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include <string.h>
+#include "sorted_array.h"
+#include "defines.h"
+
+// Capacity of the array after the first insertion.
+#define SARRAY_INITIAL_CAPACITY 4
+
+// Internal auxiliary function changing the capacity of the array.
+static void sarray_reserve(sarray_t *array, size_t capacity);
+
+
+sarray_t *sarray_make() {
+
+    sarray_t *array = malloc(sizeof(sarray_t));
+
+    // Assure that malloc has not failed.
+    NNULL(array, "sarray_make");
+
+    array->data = NULL;
+    array->size = 0;
+    array->capacity = 0;
+
+    return array;
+}
+
+void sarray_push_back(sarray_t *array, int value) {
+
+    NNULL(array, "sarray_push_back");
+
+    if(array->size == array->capacity) {
+        sarray_reserve(array, array->capacity == 0 ? SARRAY_INITIAL_CAPACITY
+                                                   : 2 * array->capacity);
+    }
+
+    array->data[array->size++] = value;
+}
+
+sarray_t *sarray_copy_prefix(sarray_t *array, size_t length) {
+
+    NNULL(array, "sarray_copy_prefix");
+
+    sarray_t *copy = sarray_make();
+
+    if(length > array->size) {
+        length = array->size;
+    }
+
+    if(length > 0) {
+
+        sarray_reserve(copy, length);
+
+        memcpy(copy->data, array->data, length * sizeof(int));
+
+        copy->size = length;
+    }
+
+    return copy;
+}
+
+void sarray_destroy(sarray_t **array) {
+
+    NNULL(*array, "sarray_destroy");
+
+    free((*array)->data);
+    free(*array);
+
+    *array = NULL;
+}
+
+static void sarray_reserve(sarray_t *array, size_t capacity) {
+
+    if(capacity == 0) {
+
+        free(array->data);
+
+        array->data = NULL;
+        array->capacity = 0;
+
+        return;
+    }
+
+    array->data = realloc(array->data, capacity * sizeof(int));
+
+    // Assure that realloc has not failed.
+    NNULL(array->data, "sarray_reserve");
+
+    array->capacity = capacity;
+}
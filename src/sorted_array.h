@@ -0,0 +1,40 @@
+/**
+ * Sorted array data structure. Holds distinct integers in descending order
+ * in a single contiguous block of memory. Used for marathon results, which
+ * are built by appending and copied as a whole.
+ * Appending takes amortised constant time.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef SORTED_ARRAY_H
+#define SORTED_ARRAY_H
+
+#include <stddef.h>
+
+// Distinct integers sorted in descending order. Data is NULL when the
+// capacity is zero, so empty arrays do not allocate any element memory.
+typedef struct sarray_t {
+
+    int *data;
+    size_t size;
+    size_t capacity;
+
+} sarray_t;
+
+// Makes a new empty array object.
+sarray_t *sarray_make();
+
+// Appends the value at the end. The value has to be smaller than
+// the current last element.
+void sarray_push_back(sarray_t *array, int value);
+
+// Makes a new array holding copies of the first length elements,
+// or all of them if there are less.
+sarray_t *sarray_copy_prefix(sarray_t *array, size_t length);
+
+// Releases all the memory held by the array and NULLs the pointer.
+void sarray_destroy(sarray_t **array);
+
+#endif // SORTED_ARRAY_H
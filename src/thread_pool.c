@@ -0,0 +1,340 @@
+/**
+ * Implementation of thread_pool.h.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "thread_pool.h"
+#include "defines.h"
+
+// Capacity of a deque after the first submission.
+#define THREAD_POOL_INITIAL_CAPACITY 64
+
+// Arguments of a worker thread.
+typedef struct thread_pool_worker_t {
+
+    thread_pool_t *pool;
+    unsigned int index;
+
+} thread_pool_worker_t;
+
+// Internal function of the worker threads.
+static void *thread_pool_worker(void *arg);
+
+// Internal auxiliary function executing tasks as the given worker
+// until there are none left to take.
+static void thread_pool_work(thread_pool_t *pool, unsigned int worker);
+
+// Internal auxiliary function returning true iff any deque has a task.
+static bool thread_pool_has_tasks(thread_pool_t *pool);
+
+// Internal auxiliary function taking a task from the bottom of the worker's
+// own deque or from the top of another one. Returns false if there are none.
+static bool thread_pool_take(thread_pool_t *pool, unsigned int worker,
+                             thread_pool_task_t *task);
+
+
+thread_pool_t *thread_pool_make(unsigned int size) {
+
+    thread_pool_t *pool = malloc(sizeof(thread_pool_t));
+
+    // Assure that malloc has not failed.
+    NNULL(pool, "thread_pool_make");
+
+    pool->size = size;
+    pool->threads = malloc(size * sizeof(pthread_t));
+    pool->deques = malloc(size * sizeof(thread_pool_deque_t));
+
+    // Assure that malloc has not failed.
+    NNULL(pool->threads, "threads/thread_pool_make");
+    NNULL(pool->deques, "deques/thread_pool_make");
+
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->running, false);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->stopping = false;
+
+    for(unsigned int i = 0; i < size; ++i) {
+
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].tasks = NULL;
+        pool->deques[i].top = 0;
+        pool->deques[i].size = 0;
+        pool->deques[i].capacity = 0;
+    }
+
+    for(unsigned int i = 1; i < size; ++i) {
+
+        thread_pool_worker_t *worker = malloc(sizeof(thread_pool_worker_t));
+
+        // Assure that malloc has not failed.
+        NNULL(worker, "worker/thread_pool_make");
+
+        worker->pool = pool;
+        worker->index = i;
+
+        if(pthread_create(&pool->threads[i], NULL, thread_pool_worker,
+                          worker) != 0) {
+
+            serr("Could not start a worker thread.\n");
+            exit(1);
+        }
+    }
+
+    return pool;
+}
+
+void thread_pool_submit(thread_pool_t *pool, unsigned int worker,
+                        thread_pool_function_t function, void *arg) {
+
+    NNULL(pool, "thread_pool_submit");
+
+    thread_pool_deque_t *deque = &pool->deques[worker];
+
+    // Counted before it is visible, so the count never drops to zero
+    // while there is work left.
+    atomic_fetch_add(&pool->pending, 1);
+
+    pthread_mutex_lock(&deque->lock);
+
+    if(deque->size == deque->capacity) {
+
+        size_t capacity = deque->capacity == 0 ? THREAD_POOL_INITIAL_CAPACITY
+                                               : 2 * deque->capacity;
+        thread_pool_task_t *tasks = malloc(capacity *
+                                           sizeof(thread_pool_task_t));
+
+        // Assure that malloc has not failed.
+        NNULL(tasks, "thread_pool_submit");
+
+        // Unwrap the ring buffer into the new one.
+        for(size_t i = 0; i < deque->size; ++i) {
+            tasks[i] = deque->tasks[(deque->top + i) % deque->capacity];
+        }
+
+        free(deque->tasks);
+
+        deque->tasks = tasks;
+        deque->top = 0;
+        deque->capacity = capacity;
+    }
+
+    size_t bottom = (deque->top + deque->size) % deque->capacity;
+
+    deque->tasks[bottom].function = function;
+    deque->tasks[bottom].arg = arg;
+    ++deque->size;
+
+    pthread_mutex_unlock(&deque->lock);
+
+    // Sleepers are counted before they look at the deques for the last
+    // time, so either they see the task or it is seen here that they sleep.
+    if(atomic_load(&pool->running) && atomic_load(&pool->sleepers) > 0) {
+
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void thread_pool_run(thread_pool_t *pool) {
+
+    NNULL(pool, "thread_pool_run");
+
+    atomic_store(&pool->running, true);
+
+    // Wake up a worker for every task submitted so far, the caller
+    // takes one of them.
+    size_t waking = atomic_load(&pool->pending);
+
+    pthread_mutex_lock(&pool->lock);
+
+    if(waking > pool->size) {
+        pthread_cond_broadcast(&pool->wake);
+    }
+    else {
+
+        for(size_t i = 1; i < waking; ++i) {
+            pthread_cond_signal(&pool->wake);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    while(true) {
+
+        thread_pool_work(pool, 0);
+
+        pthread_mutex_lock(&pool->lock);
+
+        // Wait for the tasks taken by the others, unless they submit more.
+        atomic_fetch_add(&pool->sleepers, 1);
+
+        while(atomic_load(&pool->pending) > 0 && !thread_pool_has_tasks(pool)) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+
+        atomic_fetch_sub(&pool->sleepers, 1);
+
+        bool finished = atomic_load(&pool->pending) == 0;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        if(finished) {
+
+            atomic_store(&pool->running, false);
+
+            return;
+        }
+    }
+}
+
+void thread_pool_destroy(thread_pool_t **pool) {
+
+    NNULL(*pool, "thread_pool_destroy");
+
+    pthread_mutex_lock(&(*pool)->lock);
+
+    (*pool)->stopping = true;
+    pthread_cond_broadcast(&(*pool)->wake);
+
+    pthread_mutex_unlock(&(*pool)->lock);
+
+    for(unsigned int i = 1; i < (*pool)->size; ++i) {
+        pthread_join((*pool)->threads[i], NULL);
+    }
+
+    for(unsigned int i = 0; i < (*pool)->size; ++i) {
+
+        pthread_mutex_destroy(&(*pool)->deques[i].lock);
+        free((*pool)->deques[i].tasks);
+    }
+
+    pthread_mutex_destroy(&(*pool)->lock);
+    pthread_cond_destroy(&(*pool)->wake);
+    pthread_cond_destroy(&(*pool)->done);
+
+    free((*pool)->threads);
+    free((*pool)->deques);
+    free(*pool);
+
+    *pool = NULL;
+}
+
+static void *thread_pool_worker(void *arg) {
+
+    thread_pool_worker_t worker = *(thread_pool_worker_t *) arg;
+    thread_pool_t *pool = worker.pool;
+
+    free(arg);
+
+    while(true) {
+
+        pthread_mutex_lock(&pool->lock);
+
+        atomic_fetch_add(&pool->sleepers, 1);
+
+        // Checked again once counted, so that no submission is missed.
+        while(!pool->stopping && !thread_pool_has_tasks(pool)) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+
+        atomic_fetch_sub(&pool->sleepers, 1);
+
+        bool stopping = pool->stopping;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        if(stopping) {
+            return NULL;
+        }
+
+        thread_pool_work(pool, worker.index);
+    }
+}
+
+static void thread_pool_work(thread_pool_t *pool, unsigned int worker) {
+
+    thread_pool_task_t task;
+
+    while(thread_pool_take(pool, worker, &task)) {
+
+        task.function(task.arg, worker);
+
+        // The caller waits for the last task.
+        if(atomic_fetch_sub(&pool->pending, 1) == 1) {
+
+            pthread_mutex_lock(&pool->lock);
+            pthread_cond_signal(&pool->done);
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+}
+
+static bool thread_pool_has_tasks(thread_pool_t *pool) {
+
+    for(unsigned int i = 0; i < pool->size; ++i) {
+
+        thread_pool_deque_t *deque = &pool->deques[i];
+
+        pthread_mutex_lock(&deque->lock);
+
+        bool empty = deque->size == 0;
+
+        pthread_mutex_unlock(&deque->lock);
+
+        if(!empty) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool thread_pool_take(thread_pool_t *pool, unsigned int worker,
+                             thread_pool_task_t *task) {
+
+    thread_pool_deque_t *own = &pool->deques[worker];
+
+    pthread_mutex_lock(&own->lock);
+
+    if(own->size > 0) {
+
+        --own->size;
+        *task = own->tasks[(own->top + own->size) % own->capacity];
+
+        pthread_mutex_unlock(&own->lock);
+
+        return true;
+    }
+
+    pthread_mutex_unlock(&own->lock);
+
+    for(unsigned int i = 1; i < pool->size; ++i) {
+
+        thread_pool_deque_t *victim = &pool->deques[(worker + i) % pool->size];
+
+        pthread_mutex_lock(&victim->lock);
+
+        if(victim->size > 0) {
+
+            *task = victim->tasks[victim->top];
+            victim->top = (victim->top + 1) % victim->capacity;
+            --victim->size;
+
+            pthread_mutex_unlock(&victim->lock);
+
+            return true;
+        }
+
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    return false;
+}
@@ -0,0 +1,87 @@
+/**
+ * Work-stealing thread pool for fork-join computations.
+ * Every worker has its own deque of tasks. It takes tasks from the bottom
+ * of its own deque and, when it runs out, steals from the top of the others.
+ * The thread calling thread_pool_run is worker 0 and takes part in the work,
+ * the remaining workers are threads sleeping while there is nothing to take.
+ * A run wakes up as many sleeping workers as there are tasks, a task
+ * submitted during the run wakes up one more. The caller sleeps once it has
+ * nothing to take until the last task is finished. Nobody spins, so more
+ * workers than cores only cost the memory of their threads.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Function executing a task, worker is the index of the executing worker.
+typedef void (*thread_pool_function_t)(void *arg, unsigned int worker);
+
+// A single task.
+typedef struct thread_pool_task_t {
+
+    thread_pool_function_t function;
+    void *arg;
+
+} thread_pool_task_t;
+
+// Tasks of a single worker in a ring buffer, guarded by the lock.
+typedef struct thread_pool_deque_t {
+
+    pthread_mutex_t lock;
+    thread_pool_task_t *tasks;
+    size_t top;
+    size_t size;
+    size_t capacity;
+
+} thread_pool_deque_t;
+
+// The pool of size workers, including the calling thread.
+typedef struct thread_pool_t {
+
+    unsigned int size;
+    pthread_t *threads;
+    thread_pool_deque_t *deques;
+
+    // Number of tasks submitted and not yet finished.
+    atomic_size_t pending;
+
+    // Number of workers sleeping, the caller of thread_pool_run included.
+    atomic_uint sleepers;
+
+    // True during a run, before it the submissions wake up nobody.
+    atomic_bool running;
+
+    // Sleeping workers wait on wake for a task or for the pool to stop,
+    // the caller waits on done for the last task to finish.
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    bool stopping;
+
+} thread_pool_t;
+
+// Makes a new pool with the given number of workers and starts
+// all but the first of them.
+thread_pool_t *thread_pool_make(unsigned int size);
+
+// Adds a task to the deque of the given worker. Can be called by the tasks
+// themselves, which makes the rest of the work available to thieves.
+void thread_pool_submit(thread_pool_t *pool, unsigned int worker,
+                        thread_pool_function_t function, void *arg);
+
+// Works as worker 0 until all submitted tasks, including the ones they
+// submit, are finished.
+void thread_pool_run(thread_pool_t *pool);
+
+// Stops and joins the workers, releases the resources and NULLs the pointer.
+void thread_pool_destroy(thread_pool_t **pool);
+
+#endif // THREAD_POOL_H
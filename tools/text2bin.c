@@ -0,0 +1,55 @@
+/**
+ * Converter of text commands to the binary records read by main -b.
+ * Reads lines from the standard input and writes a record for every
+ * line which is not empty or a comment to the standard output, followed
+ * by the ratings of the batches.
+ * Malformed lines become records answered with an error.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include <unistd.h>
+#include "../src/defines.h"
+#include "../src/command.h"
+#include "../src/input.h"
+#include "../src/output.h"
+
+int main() {
+
+    input_t *input = input_open(STDIN_FILENO);
+    output_t *output = output_open(STDOUT_FILENO);
+    const char *line;
+    size_t length;
+    char record[COMMAND_RECORD_SIZE];
+
+    while(input_read_line(input, &line, &length)) {
+
+        command_t command = command_parse(line, length);
+
+        if(!command_encode(command, record)) {
+            continue;
+        }
+
+        output_write(output, record, COMMAND_RECORD_SIZE);
+
+        // A batch record is followed by its ratings.
+        if(command_decode(record).listBinary) {
+
+            size_t size = command.listCount * COMMAND_LIST_ARG_SIZE;
+            char *payload = malloc(size);
+
+            // Assure that malloc has not failed.
+            NNULL(payload, "text2bin");
+
+            command_encode_list(command, payload);
+            output_write(output, payload, size);
+
+            free(payload);
+        }
+    }
+
+    output_close(&output);
+    input_close(&input);
+
+    return 0;
+}
@@ -0,0 +1,337 @@
+/**
+ * Workload generator for the Marathon benchmarks.
+ * Prints a command stream of the given shape to the standard output:
+ * a deterministic setup building the tree followed by the measured
+ * operations, either a mix typical for the shape or a single command type.
+ *
+ * Usage: workload shape phase [count] [seed]
+ * Shapes: chain, fanout, movies, churn, largek.
+ * Phases: setup, mixed, addUser, delUser, addMovie, delMovie, marathon.
+ *
+ * Author: Mateusz Gienieczko
+ * Copyright (C) 2018
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../src/defines.h"
+
+// Default number of measured operations.
+#define WORKLOAD_DEFAULT_COUNT 20000
+
+// Number of identifiers besides the root. They are the multiples
+// of the stride, spread over the whole userID range.
+#define WORKLOAD_MAX_USER 65535
+#define WORKLOAD_ID_STRIDE 65536
+
+// Ratings are drawn from [0, WORKLOAD_MAX_RATING].
+#define WORKLOAD_MAX_RATING 1000000000
+
+// Kinds of measured operations.
+typedef enum workload_op_t {
+
+    OP_ADD_USER,
+    OP_DEL_USER,
+    OP_ADD_MOVIE,
+    OP_DEL_MOVIE,
+    OP_MARATHON,
+    OP_COUNT
+
+} workload_op_t;
+
+// Names of the phases, the single operation ones in workload_op_t order.
+static const char *phaseNames[] = {
+    "addUser", "delUser", "addMovie", "delMovie", "marathon"
+};
+
+// Description of a workload shape.
+typedef struct workload_shape_t {
+
+    const char *name;
+
+    // Number of users besides the root and movies of each of them.
+    unsigned int users;
+    unsigned int moviesPerUser;
+
+    // True iff every user is a child of the previous one, false
+    // for a fan-out from the root if parent is 0, random otherwise.
+    bool chain;
+    bool randomParent;
+
+    // Length of the marathons.
+    long k;
+
+    // Weights of the operations in the mixed phase.
+    unsigned int weights[OP_COUNT];
+
+} workload_shape_t;
+
+static const workload_shape_t shapes[] = {
+    {"chain", 20000, 1, true, false, 10, {5, 5, 30, 20, 40}},
+    {"fanout", 40000, 4, false, false, 10, {10, 10, 30, 20, 30}},
+    {"movies", 64, 2000, false, true, 1000, {0, 0, 40, 40, 20}},
+    {"churn", 20000, 2, false, true, 10, {40, 40, 5, 5, 10}},
+    {"largek", 20000, 8, false, true, MAX_MARATHON, {5, 5, 20, 20, 50}},
+};
+
+// State of the generated tree.
+static unsigned int *alive;
+static size_t aliveCount = 0;
+static unsigned int *freeIDs;
+static size_t freeCount = 0;
+
+// Movies added so far as (user, rating) pairs, candidates for delMovie.
+static long *movieUsers;
+static long *movieRatings;
+static size_t movieCount = 0;
+static size_t movieCapacity = 0;
+
+// State of the xorshift generator, the same on every platform.
+static unsigned long long randomState;
+
+// Internal auxiliary function giving a pseudorandom number below bound.
+static unsigned long random_below(unsigned long bound);
+
+// Internal auxiliary functions printing single commands and updating
+// the state of the tree.
+static void add_user(unsigned int parentID, unsigned int userID);
+static void del_user(size_t alivePosition);
+static void add_movie(unsigned int userID, long rating);
+static void del_movie(size_t moviePosition);
+
+// Internal auxiliary function printing one operation of the given kind.
+// Falls back to another kind if this one is not possible right now.
+static void generate_op(const workload_shape_t *shape, workload_op_t op);
+
+// Internal auxiliary function printing the setup of the shape.
+static void generate_setup(const workload_shape_t *shape);
+
+
+int main(int argc, char **argv) {
+
+    if(argc < 3 || argc > 5) {
+
+        serr("Usage: %s shape phase [count] [seed]\n", argv[0]);
+
+        return 1;
+    }
+
+    const workload_shape_t *shape = NULL;
+
+    for(size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); ++i) {
+
+        if(strcmp(argv[1], shapes[i].name) == 0) {
+            shape = &shapes[i];
+        }
+    }
+
+    int phase = -2;
+
+    if(strcmp(argv[2], "setup") == 0) {
+        phase = -1;
+    }
+    else if(strcmp(argv[2], "mixed") == 0) {
+        phase = OP_COUNT;
+    }
+    else {
+
+        for(int i = 0; i < OP_COUNT; ++i) {
+
+            if(strcmp(argv[2], phaseNames[i]) == 0) {
+                phase = i;
+            }
+        }
+    }
+
+    if(shape == NULL || phase == -2) {
+
+        serr("Unknown shape or phase.\n");
+
+        return 1;
+    }
+
+    long count = argc > 3 ? atol(argv[3]) : WORKLOAD_DEFAULT_COUNT;
+    randomState = argc > 4 ? strtoull(argv[4], NULL, 10) : 1;
+
+    // Zero is a fixed point of xorshift.
+    if(randomState == 0) {
+        randomState = 1;
+    }
+
+    alive = malloc((WORKLOAD_MAX_USER + 1) * sizeof(unsigned int));
+    freeIDs = malloc((WORKLOAD_MAX_USER + 1) * sizeof(unsigned int));
+    NNULL(alive, "main");
+    NNULL(freeIDs, "main");
+
+    // Smallest identifiers are taken first.
+    for(unsigned int id = WORKLOAD_MAX_USER; id > 0; --id) {
+        freeIDs[freeCount++] = id * WORKLOAD_ID_STRIDE;
+    }
+
+    alive[aliveCount++] = 0;
+
+    generate_setup(shape);
+
+    for(long i = 0; phase >= 0 && i < count; ++i) {
+
+        workload_op_t op = (workload_op_t) phase;
+
+        if(phase == OP_COUNT) {
+
+            unsigned int total = 0;
+
+            for(int j = 0; j < OP_COUNT; ++j) {
+                total += shape->weights[j];
+            }
+
+            unsigned long draw = random_below(total);
+
+            for(op = 0; draw >= shape->weights[op]; ++op) {
+                draw -= shape->weights[op];
+            }
+        }
+
+        generate_op(shape, op);
+    }
+
+    free(alive);
+    free(freeIDs);
+    free(movieUsers);
+    free(movieRatings);
+
+    return 0;
+}
+
+static unsigned long random_below(unsigned long bound) {
+
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+
+    return (unsigned long) (randomState % bound);
+}
+
+static void add_user(unsigned int parentID, unsigned int userID) {
+
+    printf("addUser %u %u\n", parentID, userID);
+
+    alive[aliveCount++] = userID;
+}
+
+static void del_user(size_t alivePosition) {
+
+    unsigned int userID = alive[alivePosition];
+
+    printf("delUser %u\n", userID);
+
+    alive[alivePosition] = alive[--aliveCount];
+    freeIDs[freeCount++] = userID;
+}
+
+static void add_movie(unsigned int userID, long rating) {
+
+    printf("addMovie %u %ld\n", userID, rating);
+
+    if(movieCount == movieCapacity) {
+
+        movieCapacity = movieCapacity == 0 ? 1024 : 2 * movieCapacity;
+        movieUsers = realloc(movieUsers, movieCapacity * sizeof(long));
+        movieRatings = realloc(movieRatings, movieCapacity * sizeof(long));
+
+        NNULL(movieUsers, "add_movie");
+        NNULL(movieRatings, "add_movie");
+    }
+
+    movieUsers[movieCount] = userID;
+    movieRatings[movieCount] = rating;
+    ++movieCount;
+}
+
+static void del_movie(size_t moviePosition) {
+
+    // Movies of deleted users are gone already, this gives an error
+    // which still goes through the delMovie path.
+    printf("delMovie %ld %ld\n", movieUsers[moviePosition],
+           movieRatings[moviePosition]);
+
+    --movieCount;
+    movieUsers[moviePosition] = movieUsers[movieCount];
+    movieRatings[moviePosition] = movieRatings[movieCount];
+}
+
+static void generate_op(const workload_shape_t *shape, workload_op_t op) {
+
+    if(op == OP_ADD_USER && freeCount == 0) {
+        op = OP_DEL_USER;
+    }
+
+    if(op == OP_DEL_USER && aliveCount == 1) {
+        op = OP_ADD_USER;
+    }
+
+    if(op == OP_DEL_MOVIE && movieCount == 0) {
+        op = OP_ADD_MOVIE;
+    }
+
+    unsigned int userID = alive[random_below(aliveCount)];
+
+    switch(op) {
+
+        case OP_ADD_USER:
+            add_user(shape->chain ? alive[aliveCount - 1] : userID,
+                     freeIDs[--freeCount]);
+            break;
+
+        case OP_DEL_USER:
+            del_user(1 + random_below(aliveCount - 1));
+            break;
+
+        case OP_ADD_MOVIE:
+            add_movie(userID, (long) random_below(WORKLOAD_MAX_RATING + 1));
+            break;
+
+        case OP_DEL_MOVIE:
+            del_movie(random_below(movieCount));
+            break;
+
+        case OP_MARATHON:
+            // Half of the fan-out marathons go through the whole tree.
+            if(!shape->chain && !shape->randomParent &&
+               random_below(2) == 0) {
+
+                userID = 0;
+            }
+
+            printf("marathon %u %ld\n", userID, shape->k);
+            break;
+
+        case OP_COUNT:
+            break;
+    }
+}
+
+static void generate_setup(const workload_shape_t *shape) {
+
+    for(unsigned int i = 0; i < shape->users; ++i) {
+
+        unsigned int parentID = 0;
+
+        if(shape->chain) {
+            parentID = alive[aliveCount - 1];
+        }
+        else if(shape->randomParent) {
+            parentID = alive[random_below(aliveCount)];
+        }
+
+        add_user(parentID, freeIDs[--freeCount]);
+    }
+
+    for(size_t i = 0; i < aliveCount; ++i) {
+
+        for(unsigned int j = 0; j < shape->moviesPerUser; ++j) {
+            add_movie(alive[i],
+                      (long) random_below(WORKLOAD_MAX_RATING + 1));
+        }
+    }
+}